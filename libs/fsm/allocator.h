@@ -0,0 +1,247 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_ALLOCATOR_H
+#define FSM_ALLOCATOR_H
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fsm {
+namespace details {
+
+constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+inline void* _map_huge(const size_t size)
+{
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        return p;
+    }
+    // There are no reserved huge pages, try transparent huge pages.
+    p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    ::madvise(p, size, MADV_HUGEPAGE);
+    return p;
+}
+
+/**
+ *  \brief Parses the list of numbers like "0-3,8,10-11" from sysfs.
+ */
+inline std::vector<size_t> _parse_list(const std::string& str)
+{
+    std::vector<size_t> res;
+    size_t pos = 0;
+    while (pos < str.size()) {
+        size_t end = str.find(',', pos);
+        if (end == std::string::npos) {
+            end = str.size();
+        }
+        const std::string range = str.substr(pos, end - pos);
+        const size_t dash = range.find('-');
+        if (! range.empty() && range.find_first_not_of("0123456789-\n") == std::string::npos) {
+            const size_t first = std::stoul(range.substr(0, dash));
+            const size_t last = (dash == std::string::npos) ? first : std::stoul(range.substr(dash + 1));
+            for (size_t i = first; i <= last; ++i) {
+                res.emplace_back(i);
+            }
+        }
+        pos = end + 1;
+    }
+    return res;
+}
+
+inline std::vector<size_t> _read_list(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string str;
+    if (! std::getline(file, str)) {
+        return std::vector<size_t>();
+    }
+    return _parse_list(str);
+}
+
+} // namespace details
+
+/**
+ *  \brief  Allocator that places large blocks to huge pages.
+ *  \details  Blocks smaller than the huge page are allocated by 'operator new'. Larger blocks are
+ *            mapped with MAP_HUGETLB, if there are no reserved huge pages the transparent huge
+ *            pages are requested by madvise(MADV_HUGEPAGE).
+ */
+template<typename T>
+class huge_page_allocator
+{
+public:
+    using value_type = T;
+
+    huge_page_allocator() = default;
+
+    template<typename U>
+    huge_page_allocator(const huge_page_allocator<U>&) {}
+
+    T* allocate(const size_t n)
+    {
+        const size_t size = n * sizeof(T);
+        if (size < details::huge_page_size) {
+            return static_cast<T*>(::operator new(size));
+        }
+        void* p = details::_map_huge(round_up(size));
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, const size_t n)
+    {
+        const size_t size = n * sizeof(T);
+        if (size < details::huge_page_size) {
+            ::operator delete(p);
+        } else {
+            ::munmap(p, round_up(size));
+        }
+    }
+
+private:
+    static size_t round_up(const size_t size)
+    {
+        return (size + details::huge_page_size - 1) / details::huge_page_size * details::huge_page_size;
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const huge_page_allocator<T>&, const huge_page_allocator<U>&) { return true; }
+
+template<typename T, typename U>
+bool operator!=(const huge_page_allocator<T>&, const huge_page_allocator<U>&) { return false; }
+
+/**
+ *  \brief State container for the 'fsm' and 'compact_fsm' backed by huge pages.
+ */
+template<typename T>
+using huge_page_vector = std::vector<T, huge_page_allocator<T>>;
+
+/**
+ *  \brief  Read-only replicas of the object, one per NUMA node.
+ *  \details  Every replica is copy-constructed by a thread bound to the CPUs of the node, so its
+ *            pages are placed on that node by the first-touch policy. 'local' returns the replica
+ *            of the node the calling thread runs on. If the NUMA topology is not available, the
+ *            single replica is created.
+ *  \tparam T - copy-constructible object, e.g. 'fsm' or 'trie'.
+ */
+template<typename T>
+class numa_replicas
+{
+public:
+    using ptr = std::shared_ptr<numa_replicas<T>>;
+    using value_type = T;
+
+    explicit numa_replicas(const T& origin)
+    {
+        std::vector<size_t> nodes = details::_read_list("/sys/devices/system/node/online");
+        if (nodes.empty()) {
+            nodes.emplace_back(0);
+        }
+
+        m_replicas.resize(nodes.back() + 1);
+        for (const size_t node : nodes) {
+            std::thread th([this, &origin, node]() {
+                               bind_to_node(node);
+                               m_replicas[node] = std::make_shared<const T>(origin);
+                           });
+            th.join();
+        }
+        m_nodes_count = nodes.size();
+        m_default = m_replicas[nodes.front()];
+    }
+
+    const T& get(const size_t node) const
+    {
+        if ((node < m_replicas.size()) && m_replicas[node]) {
+            return *m_replicas[node];
+        }
+        return *m_default;
+    }
+
+    const T& local() const { return get(current_node()); }
+
+    size_t nodes_count() const { return m_nodes_count; }
+
+    /**
+     *  \brief Returns the NUMA node of the calling thread. The node is cached per thread, so
+     *         threads are expected to be bound to nodes.
+     */
+    static size_t current_node()
+    {
+        thread_local const size_t node = []() -> size_t {
+                unsigned cpu = 0;
+                unsigned node = 0;
+                if (::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+                    return 0;
+                }
+                return node;
+            }();
+        return node;
+    }
+
+private:
+    static void bind_to_node(const size_t node)
+    {
+        const std::vector<size_t> cpus =
+            details::_read_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (cpus.empty()) {
+            return;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const size_t cpu : cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        ::sched_setaffinity(0, sizeof(set), &set);
+    }
+
+private:
+    std::vector<std::shared_ptr<const T>> m_replicas;
+    std::shared_ptr<const T> m_default;
+    size_t m_nodes_count = 0;
+};
+
+} // namespace fsm
+
+#endif // FSM_ALLOCATOR_H
@@ -0,0 +1,241 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_COMPACT_FSM_H
+#define FSM_COMPACT_FSM_H
+
+#include <cassert>
+#include <cstdint>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "fsm/fsm.h"
+
+namespace fsm {
+namespace details {
+
+template<typename TRows, typename TEv>
+typename TRows::value_type _follow_row(const TRows& rows, const size_t row_size, const size_t st, const TEv& ev)
+{
+    const size_t idx = _event_index(ev);
+    // The last cell of the row holds the availability flag, not a transition.
+    if (idx + 1 >= row_size) {
+        return 0;
+    }
+    return rows[st * row_size + idx];
+}
+
+} // namespace details
+
+/**
+ *  \brief  Read-only flat representation of the fsm with the narrowest state id width.
+ *  \details  Every state is stored as a row of 'alphabet_size() + 1' cells, where the last cell
+ *            is the availability flag. The width of a cell (1, 2 or 4 bytes) is selected by the
+ *            number of states, so small automata use 4 times less memory per row.
+ *  \tparam TTrans
+ *  \tparam TRowCont
+ */
+template<typename TTrans, template<typename> class TRowCont = std::vector>
+class compact_fsm
+{
+    using compact_fsm_type = compact_fsm<TTrans, TRowCont>;
+
+public:
+    using event_type = typename TTrans::event_type;
+    using ptr = std::shared_ptr<compact_fsm_type>;
+    using state_id = typename TTrans::state_type;
+
+    static constexpr state_id begin_state = 1u;
+    static constexpr state_id invalid_state = 0u;
+
+    compact_fsm() = default;
+
+    template<template<typename> class TStateCont, typename TStats>
+    explicit compact_fsm(const fsm<TTrans, TStateCont, TStats>& other) { assign(other); }
+
+    compact_fsm(const compact_fsm& other) = default;
+
+    compact_fsm(compact_fsm&& other) = default;
+
+    compact_fsm& operator=(const compact_fsm& other) = default;
+
+    compact_fsm& operator=(compact_fsm&& other) = default;
+
+    size_t alphabet_size() const { return (m_row_size > 0) ? (m_row_size - 1) : 0; }
+
+    template<template<typename> class TStateCont, typename TStats>
+    void assign(const fsm<TTrans, TStateCont, TStats>& other)
+    {
+        clear();
+
+        size_t row_size = 1;
+        for (size_t st = 0; st < other.size(); ++st) {
+            other.for_each_trans(st, [&row_size](const event_type& ev, const state_id&) {
+                                         row_size = std::max(row_size, details::_event_index(ev) + 2);
+                                     });
+        }
+
+        m_row_size = row_size;
+        m_size = other.size();
+        if (m_size <= (size_t)std::numeric_limits<uint8_t>::max() + 1) {
+            m_width = sizeof(uint8_t);
+            fill(other, m_rows8);
+        } else if (m_size <= (size_t)std::numeric_limits<uint16_t>::max() + 1) {
+            m_width = sizeof(uint16_t);
+            fill(other, m_rows16);
+        } else {
+            m_width = sizeof(uint32_t);
+            fill(other, m_rows32);
+        }
+    }
+
+    const state_id& begin() const { return begin_state; }
+
+    void clear()
+    {
+        m_rows8.clear();
+        m_rows16.clear();
+        m_rows32.clear();
+        m_row_size = 0;
+        m_size = 0;
+        m_width = 0;
+    }
+
+    state_id follow(const state_id& st, const event_type& ev) const
+    {
+        assert((st < m_size) && "compact_fsm::follow(): invalid state");
+        switch (m_width) {
+        case sizeof(uint8_t):  return details::_follow_row(m_rows8, m_row_size, st, ev);
+        case sizeof(uint16_t): return details::_follow_row(m_rows16, m_row_size, st, ev);
+        default:               return details::_follow_row(m_rows32, m_row_size, st, ev);
+        }
+    }
+
+    template<template<typename> class TCont>
+    bool follow(const TCont<event_type>& cnt) const
+    {
+        switch (m_width) {
+        case sizeof(uint8_t):  return follow_all(m_rows8, cnt);
+        case sizeof(uint16_t): return follow_all(m_rows16, cnt);
+        case sizeof(uint32_t): return follow_all(m_rows32, cnt);
+        default:               return false;
+        }
+    }
+
+    /**
+     *  \brief Calls fn(ev, to) for every transition of the state 'st' in ascending order of events
+     *         as unsigned values, as 'fsm::for_each_trans'.
+     */
+    template<typename TFn>
+    void for_each_trans(const state_id& st, TFn fn) const
+    {
+        assert((st < m_size) && "compact_fsm::for_each_trans(): invalid state");
+        for (size_t i = 0; i + 1 < m_row_size; ++i) {
+            const state_id to = follow(st, static_cast<event_type>(i));
+            if (to != invalid_state) {
+                fn(static_cast<event_type>(i), to);
+            }
+        }
+    }
+
+    const state_id& invalid() const { return invalid_state; }
+
+    bool is_available(const state_id& st) const
+    {
+        assert((st < m_size) && "compact_fsm::is_available(): invalid state");
+        switch (m_width) {
+        case sizeof(uint8_t):  return m_rows8[(st + 1) * m_row_size - 1] != 0;
+        case sizeof(uint16_t): return m_rows16[(st + 1) * m_row_size - 1] != 0;
+        default:               return m_rows32[(st + 1) * m_row_size - 1] != 0;
+        }
+    }
+
+    /**
+     *  \brief Always true, 'follow' returns 'invalid()' for events out of the alphabet.
+     */
+    bool is_valid_event(const event_type&) const { return true; }
+
+    size_t size() const { return m_size; }
+
+    /**
+     *  \brief Returns the width of a state id in bytes.
+     */
+    size_t state_width() const { return m_width; }
+
+    void swap(compact_fsm& other)
+    {
+        if (this == &other) {
+            return;
+        }
+        std::swap(m_rows8, other.m_rows8);
+        std::swap(m_rows16, other.m_rows16);
+        std::swap(m_rows32, other.m_rows32);
+        std::swap(m_row_size, other.m_row_size);
+        std::swap(m_size, other.m_size);
+        std::swap(m_width, other.m_width);
+    }
+
+private:
+    template<typename TId, template<typename> class TStateCont, typename TStats>
+    void fill(const fsm<TTrans, TStateCont, TStats>& other, TRowCont<TId>& rows) const
+    {
+        rows.assign(m_size * m_row_size, 0);
+        for (size_t st = 0; st < m_size; ++st) {
+            TId* p_row = rows.data() + st * m_row_size;
+            other.for_each_trans(st, [p_row](const event_type& ev, const state_id& to) {
+                                         p_row[details::_event_index(ev)] = static_cast<TId>(to);
+                                     });
+            p_row[m_row_size - 1] = other.is_available(st) ? 1 : 0;
+        }
+    }
+
+    template<typename TId, template<typename> class TCont>
+    bool follow_all(const TRowCont<TId>& rows, const TCont<event_type>& cnt) const
+    {
+        size_t st = begin_state;
+        for (const event_type& ev : cnt) {
+            st = details::_follow_row(rows, m_row_size, st, ev);
+            if (st == invalid_state) {
+                return false;
+            }
+        }
+        return rows[(st + 1) * m_row_size - 1] != 0;
+    }
+
+private:
+    TRowCont<uint8_t> m_rows8;
+    TRowCont<uint16_t> m_rows16;
+    TRowCont<uint32_t> m_rows32;
+    size_t m_row_size = 0;
+    size_t m_size = 0;
+    size_t m_width = 0;
+};
+
+} // namespace fsm
+
+#endif // FSM_COMPACT_FSM_H
@@ -27,12 +27,22 @@
 
 #include <cassert>
 
+#include <algorithm>
 #include <memory>
+#include <type_traits>
 #include <vector>
 
+#include "fsm/stats.h"
+
 namespace fsm {
 namespace details {
 
+template<typename TEv>
+size_t _event_index(const TEv& ev)
+{
+    return static_cast<size_t>(static_cast<std::make_unsigned_t<TEv>>(ev));
+}
+
 template<typename TEv, typename TTbl>
 typename TTbl::value_type _follow_flat(const TEv& ev, const TTbl& tbl) { return tbl[ev]; }
 
@@ -56,9 +66,59 @@ bool _insert_flat(const TEv& ev, const TSt& st, TTbl& tbl)
     return false;
 }
 
+template<typename TEv, typename TTbl>
+bool _is_valid_flat(const TEv& ev, const TTbl& tbl) { return (tbl.size() > (size_t)ev); }
+
 template<typename TEv, typename TSt, typename TTbl>
 bool _insert_flex(const TEv& ev, const TSt& st, TTbl& tbl) { return tbl.emplace(ev, st).second; }
 
+template<typename TTbl, typename TMap>
+void _remap_flat(TTbl& tbl, const TMap& map)
+{
+    for (size_t i = 0; i < tbl.size(); ++i) {
+        tbl[i] = map[tbl[i]];
+    }
+}
+
+template<typename TTbl, typename TMap>
+void _remap_flex(TTbl& tbl, const TMap& map)
+{
+    for (typename TTbl::iterator it = tbl.begin(); it != tbl.end(); ++it) {
+        it->second = map[it->second];
+    }
+}
+
+template<typename TEv, typename TTbl, typename TFn>
+void _for_each_flat(const TTbl& tbl, TFn& fn)
+{
+    for (size_t i = 0; i < tbl.size(); ++i) {
+        if (tbl[i] != 0) {
+            fn(static_cast<TEv>(i), tbl[i]);
+        }
+    }
+}
+
+template<typename TEv, typename TTbl, typename TFn>
+void _for_each_flex(const TTbl& tbl, TFn& fn)
+{
+    // Events are visited in the unsigned order as in flat tables, so for the signed event type
+    // non-negative events go before negative ones.
+    typename TTbl::const_iterator mid = tbl.cbegin();
+    if constexpr (std::is_signed_v<TEv>) {
+        mid = tbl.lower_bound(TEv(0));
+    }
+    for (typename TTbl::const_iterator it = mid; it != tbl.cend(); ++it) {
+        if (it->second != 0) {
+            fn(it->first, it->second);
+        }
+    }
+    for (typename TTbl::const_iterator it = tbl.cbegin(); it != mid; ++it) {
+        if (it->second != 0) {
+            fn(it->first, it->second);
+        }
+    }
+}
+
 } // namespace details
 
 template<typename TEv, typename TSt, typename TTbl, bool TIsFlat>
@@ -71,11 +131,23 @@ struct trans_traits final
     static constexpr bool is_flat = TIsFlat;
 };
 
+/**
+ *  \brief  Result of 'try_insert'.
+ */
+enum class insert_status
+{
+    ok,
+    exists,         // the key (the transition) already exists
+    invalid_event,  // the event is out of the alphabet of the flat table
+    no_capacity     // the insert requires more states than reserved
+};
+
 /**
  *  \tparam TTrans
  *  \tparam TStateCont
+ *  \tparam TStats - statistics policy of lookups (see 'null_stats' and 'counting_stats').
  */
-template<typename TTrans, template<typename> class TStateCont = std::vector>
+template<typename TTrans, template<typename> class TStateCont = std::vector, typename TStats = null_stats>
 class fsm
 {
 private:
@@ -99,6 +171,36 @@ private:
             }
         }
 
+        bool is_valid(const typename TTrans::event_type& ev) const
+        {
+            if constexpr (TTrans::is_flat) {
+                return details::_is_valid_flat(ev, table);
+            } else {
+                (void)ev;
+                return true;
+            }
+        }
+
+        template<typename TFn>
+        void for_each(TFn&& fn) const
+        {
+            if constexpr (TTrans::is_flat) {
+                details::_for_each_flat<typename TTrans::event_type>(table, fn);
+            } else {
+                details::_for_each_flex<typename TTrans::event_type>(table, fn);
+            }
+        }
+
+        template<typename TMap>
+        void remap(const TMap& map)
+        {
+            if constexpr (TTrans::is_flat) {
+                details::_remap_flat(table, map);
+            } else {
+                details::_remap_flex(table, map);
+            }
+        }
+
         typename TTrans::table_type table;
         bool is_available = false;
     };
@@ -107,7 +209,7 @@ private:
 
 public:
     using event_type = typename TTrans::event_type;
-    using ptr = std::shared_ptr<fsm<TTrans, TStateCont>>;
+    using ptr = std::shared_ptr<fsm<TTrans, TStateCont, TStats>>;
     using state_id = typename TTrans::state_type;
 
     static constexpr state_id begin_state = 1u;
@@ -152,8 +254,29 @@ public:
 
     const state_id& begin() const { return begin_state; }
 
+    size_t capacity() const { return m_states.capacity(); }
+
     void clear() { m_states.clear(); }
 
+    /**
+     *  \brief Increments 'visits' of every state passed by the key. Used to collect the query log
+     *         for 'relayout'.
+     */
+    template<template<typename> class TCont>
+    void count_visits(const TCont<event_type>& cnt, std::vector<size_t>& visits) const
+    {
+        visits.resize(m_states.size(), 0);
+        state_id st = begin_state;
+        ++visits[st];
+        for (const event_type& ev : cnt) {
+            st = follow(st, ev);
+            if (st == invalid_state) {
+                return;
+            }
+            ++visits[st];
+        }
+    }
+
     state_id follow(const state_id& st, const event_type& ev) const
     {
         assert((st < m_states.size()) && "fsm::follow(): invalid state");
@@ -164,18 +287,42 @@ public:
     bool follow(const TCont<event_type>& cnt) const
     {
         state_id st = begin_state;
+        size_t depth = 0;
         for (const event_type& ev : cnt) {
             st = follow(st, ev);
             if (st == invalid_state) {
+                TStats::on_lookup(depth, lookup_result::rejected);
                 return false;
             }
+            ++depth;
         }
-        return is_available(st);
+        const bool res = is_available(st);
+        TStats::on_lookup(depth, res ? lookup_result::accepted : lookup_result::not_available);
+        return res;
+    }
+
+    /**
+     *  \brief Calls fn(ev, to) for every transition of the state 'st' in ascending order of events
+     *         as unsigned values (see 'details::_event_index') for both flat and flex tables.
+     */
+    template<typename TFn>
+    void for_each_trans(const state_id& st, TFn fn) const
+    {
+        assert((st < m_states.size()) && "fsm::for_each_trans(): invalid state");
+        m_states[st].for_each(fn);
     }
 
     template<template<typename> class TCont>
     bool insert(const TCont<event_type>& cnt)
     {
+        // All tables have the same alphabet, so events are checked before any change to not leave
+        // the orphaned prefix of the rejected key.
+        for (const event_type& ev : cnt) {
+            if (! is_valid_event(ev)) {
+                return false;
+            }
+        }
+
         state_id st = begin_state;
         for (size_t i = 0; i < cnt.size(); ++i) {
             const event_type& ev = cnt[i];
@@ -193,11 +340,18 @@ public:
     {
         assert((from < m_states.size()) && "fsm::insert(): invalid state 'from'");
 
-        const state_id to = make_state_id();
-
-        if (! m_states[from].insert(ev, to)) {
+        // Check the event before the new state is created to not leave it orphaned.
+        if (! m_states[from].is_valid(ev)) {
             return invalid_state;
         }
+        if constexpr (! TTrans::is_flat) {
+            if (m_states[from].follow(ev) != invalid_state) {
+                return invalid_state;
+            }
+        }
+
+        const state_id to = make_state_id();
+        m_states[from].insert(ev, to);
         m_states[to].is_available = is_available;
         return to;
     }
@@ -210,6 +364,22 @@ public:
         return m_states[st].is_available;
     }
 
+    /**
+     *  \brief Returns false if the event is out of the alphabet of the flat table, such events
+     *         must not be passed to 'follow'.
+     */
+    bool is_valid_event(const event_type& ev) const { return m_states[begin_state].is_valid(ev); }
+
+    /**
+     *  \brief Adds the transition 'from' -> 'to' by the event 'ev' between existing states.
+     */
+    bool link(const state_id& from, const event_type& ev, const state_id& to)
+    {
+        assert((from < m_states.size()) && "fsm::link(): invalid state 'from'");
+        assert((to < m_states.size()) && "fsm::link(): invalid state 'to'");
+        return m_states[from].insert(ev, to);
+    }
+
     void make_available(const state_id& st) { m_states[st].is_available = true; }
 
     state_id make_state_id()
@@ -218,7 +388,103 @@ public:
         return (m_states.size() - 1);
     }
 
-    void reserve(const size_t size) const { m_states.reserve(size); }
+    /**
+     *  \brief Starts loading of the transition of the state 'st' by the event 'ev' into the cache.
+     */
+    void prefetch(const state_id& st, const event_type& ev) const
+    {
+        assert((st < m_states.size()) && "fsm::prefetch(): invalid state");
+        if constexpr (TTrans::is_flat) {
+            if (m_states[st].is_valid(ev)) {
+                __builtin_prefetch(&m_states[st].table[ev]);
+            }
+        } else {
+            (void)ev;
+            __builtin_prefetch(&m_states[st]);
+        }
+    }
+
+    /**
+     *  \brief Renumbers states so the states passed by one lookup are placed close to each other.
+     *  \details  States of the first 'bfs_depth' levels are numbered in BFS order, deeper states are
+     *            numbered in DFS order, so every deep subtree occupies a contiguous range. Children
+     *            with more 'visits' (see 'count_visits') are placed first. Unreachable states are
+     *            removed.
+     *  \return  The map from old state ids to new ones. Removed states are mapped to 'invalid()'.
+     */
+    std::vector<state_id> relayout(const std::vector<size_t>& visits = std::vector<size_t>(),
+                                   const size_t bfs_depth = 2)
+    {
+        std::vector<state_id> map(m_states.size(), invalid_state);
+        std::vector<state_id> order;
+        order.reserve(m_states.size());
+        order.emplace_back(invalid_state);
+        order.emplace_back(begin_state);
+        map[begin_state] = begin_state;
+
+        std::vector<state_id> children;
+        const auto collect = [this, &visits, &map, &children](const state_id& st) {
+                children.clear();
+                m_states[st].for_each([&map, &children](const event_type&, const state_id& to) {
+                                          if (map[to] == invalid_state) {
+                                              children.emplace_back(to);
+                                          }
+                                      });
+                if (! visits.empty()) {
+                    std::stable_sort(children.begin(), children.end(),
+                                     [&visits](const state_id& l, const state_id& r) {
+                                         const size_t l_cnt = (l < visits.size()) ? visits[l] : 0;
+                                         const size_t r_cnt = (r < visits.size()) ? visits[r] : 0;
+                                         return l_cnt > r_cnt;
+                                     });
+                }
+            };
+
+        // BFS for the top levels.
+        size_t level_begin = 1;
+        for (size_t level = 0; level < bfs_depth && level_begin < order.size(); ++level) {
+            const size_t level_end = order.size();
+            for (size_t i = level_begin; i < level_end; ++i) {
+                collect(order[i]);
+                for (const state_id& to : children) {
+                    if (map[to] == invalid_state) {
+                        map[to] = order.size();
+                        order.emplace_back(to);
+                    }
+                }
+            }
+            level_begin = level_end;
+        }
+
+        // DFS below the BFS levels.
+        std::vector<state_id> stack;
+        const size_t frontier_end = order.size();
+        for (size_t i = level_begin; i < frontier_end; ++i) {
+            stack.emplace_back(order[i]);
+            while (! stack.empty()) {
+                const state_id st = stack.back();
+                stack.pop_back();
+                if (map[st] == invalid_state) {
+                    map[st] = order.size();
+                    order.emplace_back(st);
+                } else if (st != order[i]) {
+                    continue;
+                }
+                collect(st);
+                stack.insert(stack.end(), children.rbegin(), children.rend());
+            }
+        }
+
+        state_table states(order.size(), state_t());
+        for (size_t i = 1; i < order.size(); ++i) {
+            states[i] = std::move(m_states[order[i]]);
+            states[i].remap(map);
+        }
+        std::swap(m_states, states);
+        return map;
+    }
+
+    void reserve(const size_t size) { m_states.reserve(size); }
 
     size_t size() const { return m_states.size(); }
 
@@ -230,6 +496,58 @@ public:
         std::swap(m_states, other.m_states);
     }
 
+    /**
+     *  \brief Inserts the key without the reallocation of states.
+     *  \details  The key is not changed unless the whole key fits in the reserved capacity (see
+     *            'reserve'), so for flat tables the insert never calls the allocator.
+     *  \param  st - the final state of the key if the result is 'ok' or 'exists'.
+     */
+    template<template<typename> class TCont>
+    insert_status try_insert(const TCont<event_type>& cnt, state_id& st)
+    {
+        // All tables have the same alphabet, so events are checked before any change.
+        for (const event_type& ev : cnt) {
+            if (! is_valid_event(ev)) {
+                return insert_status::invalid_event;
+            }
+        }
+
+        st = begin_state;
+        size_t matched = 0;
+        for (const event_type& ev : cnt) {
+            const state_id st_to = follow(st, ev);
+            if (st_to == invalid_state) {
+                break;
+            }
+            st = st_to;
+            ++matched;
+        }
+
+        const size_t missing = cnt.size() - matched;
+        if (missing == 0) {
+            if (is_available(st)) {
+                return insert_status::exists;
+            }
+            make_available(st);
+            return insert_status::ok;
+        }
+        if (missing > m_states.capacity() - m_states.size()) {
+            return insert_status::no_capacity;
+        }
+        for (size_t i = matched; i < cnt.size(); ++i) {
+            st = insert(st, cnt[i], false);
+        }
+        make_available(st);
+        return insert_status::ok;
+    }
+
+    template<template<typename> class TCont>
+    insert_status try_insert(const TCont<event_type>& cnt)
+    {
+        state_id st = invalid_state;
+        return try_insert(cnt, st);
+    }
+
 private:
     state_table m_states;
 };
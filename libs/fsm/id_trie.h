@@ -0,0 +1,229 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_ID_TRIE_H
+#define FSM_ID_TRIE_H
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "fsm/fsm.h"
+
+namespace fsm {
+
+/**
+ *  \brief  Trie that maps every accepted key to the dense id in range [0, keys_count()) without
+ *          the value store, and back.
+ *  \details  Every state keeps the number of accepted keys lexicographically (by the unsigned event
+ *            value) less than its prefix, so the id of the key is this number of the final state,
+ *            i.e. the minimal perfect hash of the key set preserving the order. Ids are valid
+ *            after 'index()' and are changed by the following 'insert'.
+ *  \tparam TTrans
+ *  \tparam TStateCont
+ */
+template<typename TTrans, template<typename> class TStateCont = std::vector>
+class id_trie
+{
+    using fsm_type = fsm<TTrans, TStateCont>;
+    using id_trie_type = id_trie<TTrans, TStateCont>;
+
+public:
+    using event_type = typename fsm_type::event_type;
+    using id_type = typename fsm_type::state_id;
+    using ptr = std::shared_ptr<id_trie_type>;
+    using state_id = typename fsm_type::state_id;
+
+    static constexpr id_type invalid_id = std::numeric_limits<id_type>::max();
+
+    id_trie() = default;
+
+    explicit id_trie(const size_t reserve_size)
+        : m_fsm(reserve_size)
+    {}
+
+    const state_id& begin() const { return m_fsm.begin(); }
+
+    void clear()
+    {
+        m_fsm = fsm_type();
+        m_ranks.clear();
+        m_count = 0;
+        m_is_indexed = true;
+    }
+
+    state_id follow(const state_id& st, const event_type& ev) const { return m_fsm.follow(st, ev); }
+
+    template<template<typename> class TCont>
+    bool follow(const TCont<event_type>& cnt) const { return m_fsm.follow(cnt); }
+
+    template<typename TFn>
+    void for_each_trans(const state_id& st, TFn fn) const { m_fsm.for_each_trans(st, fn); }
+
+    /**
+     *  \brief Returns the id of the key or 'invalid_id' if the key is not accepted or 'index()'
+     *         is not called after the last 'insert'.
+     */
+    template<template<typename> class TCont>
+    id_type id(const TCont<event_type>& cnt) const
+    {
+        if (! m_is_indexed) {
+            return invalid_id;
+        }
+
+        state_id st = begin();
+        for (const event_type& ev : cnt) {
+            st = follow(st, ev);
+            if (st == invalid()) {
+                return invalid_id;
+            }
+        }
+        return (is_available(st) && (st < m_ranks.size())) ? m_ranks[st] : invalid_id;
+    }
+
+    /**
+     *  \brief Recomputes ids of keys by the preorder traversal of the trie.
+     */
+    void index()
+    {
+        m_ranks.assign(m_fsm.size(), 0);
+
+        id_type rank = 0;
+        std::vector<state_id> stack(1, begin());
+        std::vector<state_id> children;
+        while (! stack.empty()) {
+            const state_id st = stack.back();
+            stack.pop_back();
+
+            m_ranks[st] = rank;
+            if (is_available(st)) {
+                ++rank;
+            }
+
+            // Transitions go in the unsigned order of events (see 'fsm::for_each_trans').
+            children.clear();
+            for_each_trans(st, [&children](const event_type&, const state_id& to) { children.emplace_back(to); });
+            stack.insert(stack.end(), children.rbegin(), children.rend());
+        }
+        m_is_indexed = true;
+    }
+
+    /**
+     *  \brief Inserts the key.
+     *  \return false if the key contains an event out of the alphabet.
+     */
+    template<template<typename> class TCont>
+    bool insert(const TCont<event_type>& cnt)
+    {
+        // Events are checked before any change as in 'fsm::insert'.
+        for (const event_type& ev : cnt) {
+            if (! is_valid_event(ev)) {
+                return false;
+            }
+        }
+
+        state_id st = begin();
+        for (const event_type& ev : cnt) {
+            state_id st_to = follow(st, ev);
+            if (st_to == invalid()) {
+                st_to = m_fsm.insert(st, ev, false);
+                if (st_to == invalid()) {
+                    return false;
+                }
+            }
+            st = st_to;
+        }
+        if (! is_available(st)) {
+            m_fsm.make_available(st);
+            ++m_count;
+            m_is_indexed = false;
+        }
+        return true;
+    }
+
+    const state_id& invalid() const { return m_fsm.invalid(); }
+
+    bool is_available(const state_id& st) const { return m_fsm.is_available(st); }
+
+    bool is_valid_event(const event_type& ev) const { return m_fsm.is_valid_event(ev); }
+
+    /**
+     *  \brief Restores the key by its id.
+     *  \return false if there is no key with the id or 'index()' is not called after the last
+     *          'insert'.
+     */
+    template<template<typename> class TCont>
+    bool key(const id_type id, TCont<event_type>& cnt) const
+    {
+        cnt.clear();
+        if (! m_is_indexed || (id >= m_count)) {
+            return false;
+        }
+
+        // Ranks of children grow in the order of events, so the subtree holding the id is
+        // the last child with the rank not greater than the id.
+        state_id st = begin();
+        while (! (is_available(st) && (m_ranks[st] == id))) {
+            event_type next_ev = event_type();
+            state_id next = invalid();
+            for_each_trans(st, [this, id, &next_ev, &next](const event_type& ev, const state_id& to) {
+                                   if (m_ranks[to] <= id) {
+                                       next_ev = ev;
+                                       next = to;
+                                   }
+                               });
+            if (next == invalid()) {
+                return false;
+            }
+            cnt.push_back(next_ev);
+            st = next;
+        }
+        return true;
+    }
+
+    size_t keys_count() const { return m_count; }
+
+    size_t size() const { return m_fsm.size(); }
+
+    void swap(id_trie& other)
+    {
+        if (this == &other) {
+            return;
+        }
+        m_fsm.swap(other.m_fsm);
+        std::swap(m_ranks, other.m_ranks);
+        std::swap(m_count, other.m_count);
+        std::swap(m_is_indexed, other.m_is_indexed);
+    }
+
+private:
+    fsm_type m_fsm;
+    std::vector<id_type> m_ranks;
+    size_t m_count = 0;
+    bool m_is_indexed = true;
+};
+
+} // namespace fsm
+
+#endif // FSM_ID_TRIE_H
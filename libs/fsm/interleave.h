@@ -0,0 +1,175 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_INTERLEAVE_H
+#define FSM_INTERLEAVE_H
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine)
+    #include <coroutine>
+#endif
+
+namespace fsm {
+
+/**
+ *  \brief  Interleaves independent lookups in one thread to overlap their cache misses.
+ *  \details  Every 'step' makes one transition of every lookup in flight and prefetches the
+ *            transition of the next step, so while one lookup waits for the memory the others
+ *            proceed. Lookups are submitted at any time, also from the completion callbacks. With
+ *            C++20 coroutines 'co_await scheduler.async_follow(key)' suspends the coroutine until
+ *            the lookup is completed by 'step'/'run'.
+ *            Keys are not copied and must live until the completion. A key with an event out of
+ *            the alphabet is completed with 'invalid()'.
+ *  \tparam TFsm - fsm or trie.
+ *  \tparam TFn - the completion callback 'void(const state_id&)'.
+ */
+template<typename TFsm, typename TFn = std::function<void(const typename TFsm::state_id&)>>
+class lookup_scheduler
+{
+    struct lookup_t final
+    {
+        const typename TFsm::event_type* p_key;
+        size_t size;
+        size_t pos;
+        typename TFsm::state_id st;
+        TFn fn;
+    };
+
+public:
+    using event_type = typename TFsm::event_type;
+    using state_id = typename TFsm::state_id;
+
+    explicit lookup_scheduler(const TFsm& fsm, const size_t max_in_flight = 16)
+        : m_fsm(fsm)
+        , m_max_in_flight(std::max<size_t>(max_in_flight, 1))
+    {
+        m_lookups.reserve(m_max_in_flight);
+    }
+
+#if defined(__cpp_impl_coroutine)
+    template<template<typename> class TCont>
+    auto async_follow(const TCont<event_type>& cnt)
+    {
+        struct awaiter final
+        {
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                scheduler.submit(p_key, size, [this, handle](const state_id& st) {
+                                                  result = st;
+                                                  handle.resume();
+                                              });
+            }
+
+            state_id await_resume() const noexcept { return result; }
+
+            lookup_scheduler& scheduler;
+            const event_type* p_key;
+            size_t size;
+            state_id result;
+        };
+        return awaiter{*this, cnt.data(), cnt.size(), m_fsm.invalid()};
+    }
+#endif
+
+    size_t in_flight() const { return m_lookups.size(); }
+
+    size_t pending() const { return m_pending.size(); }
+
+    /**
+     *  \brief Runs steps until all lookups, including submitted by callbacks, are completed.
+     */
+    void run()
+    {
+        while (step() > 0) {}
+    }
+
+    /**
+     *  \brief Makes one transition of every lookup in flight.
+     *  \return  The number of lookups in flight and pending.
+     */
+    size_t step()
+    {
+        while ((m_lookups.size() < m_max_in_flight) && (! m_pending.empty())) {
+            m_lookups.emplace_back(std::move(m_pending.front()));
+            m_pending.pop_front();
+            lookup_t& lookup = m_lookups.back();
+            if (lookup.pos < lookup.size) {
+                m_fsm.prefetch(lookup.st, lookup.p_key[lookup.pos]);
+            }
+        }
+
+        for (size_t i = 0; i < m_lookups.size();) {
+            lookup_t& lookup = m_lookups[i];
+            if (lookup.pos < lookup.size) {
+                const event_type& ev = lookup.p_key[lookup.pos++];
+                lookup.st = m_fsm.is_valid_event(ev) ? m_fsm.follow(lookup.st, ev) : m_fsm.invalid();
+            }
+            if ((lookup.st != m_fsm.invalid()) && (lookup.pos < lookup.size)) {
+                m_fsm.prefetch(lookup.st, lookup.p_key[lookup.pos]);
+                ++i;
+                continue;
+            }
+
+            // The callback may submit new lookups, so it is called after the lookup is removed.
+            const state_id st = ((lookup.st != m_fsm.invalid()) && m_fsm.is_available(lookup.st))
+                                    ? lookup.st : m_fsm.invalid();
+            TFn fn = std::move(lookup.fn);
+            if (i + 1 != m_lookups.size()) {
+                lookup = std::move(m_lookups.back());
+            }
+            m_lookups.pop_back();
+            fn(st);
+        }
+        return m_lookups.size() + m_pending.size();
+    }
+
+    /**
+     *  \brief Submits the lookup, 'fn' is called with the final state of the accepted key or
+     *         with 'invalid()'.
+     */
+    void submit(const event_type* p_key, const size_t size, TFn fn)
+    {
+        m_pending.push_back(lookup_t{p_key, size, 0, m_fsm.begin(), std::move(fn)});
+    }
+
+    template<template<typename> class TCont>
+    void submit(const TCont<event_type>& cnt, TFn fn) { submit(cnt.data(), cnt.size(), std::move(fn)); }
+
+private:
+    const TFsm& m_fsm;
+    const size_t m_max_in_flight;
+    std::vector<lookup_t> m_lookups;
+    std::deque<lookup_t> m_pending;
+};
+
+} // namespace fsm
+
+#endif // FSM_INTERLEAVE_H
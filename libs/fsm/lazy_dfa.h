@@ -0,0 +1,204 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_LAZY_DFA_H
+#define FSM_LAZY_DFA_H
+
+#include <cstdint>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "fsm/regex.h"
+
+namespace fsm {
+
+/**
+ *  \brief  DFA of the 'regex_set' that materializes states on demand during scanning.
+ *  \details  Every materialized state is a row of 'alphabet_size()' transitions, unknown
+ *            transitions are computed from the NFA at the first use. The number of rows is bounded
+ *            by 'max_states', when the cache is full it is flushed. If the cache is flushed more
+ *            than 'max_flushes' times during one input, the rest of the input is processed by the
+ *            NFA simulation, so memory stays bounded on adversarial inputs.
+ *            The object is not thread-safe, use one per thread.
+ *  \tparam TTrans
+ */
+template<typename TTrans>
+class lazy_dfa
+{
+    using row_id = uint32_t;
+    using set_type = std::vector<size_t>;
+
+    static constexpr row_id unknown_row = (row_id)-1;
+    static constexpr row_id dead_row = 0;
+
+    struct row_t final
+    {
+        set_type set;
+        std::vector<row_id> next;
+        std::vector<size_t> accepts;
+    };
+
+public:
+    using event_type = typename TTrans::event_type;
+    using id_list = std::vector<size_t>;
+    using ptr = std::shared_ptr<lazy_dfa<TTrans>>;
+
+    struct stats final
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t flushes = 0;
+        uint64_t nfa_fallbacks = 0;
+    };
+
+    template<template<typename> class TStateCont>
+    explicit lazy_dfa(const regex_set<TTrans, TStateCont>& regex, const size_t max_states = 4096,
+                      const size_t max_flushes = 8)
+        : m_nfa(regex.nfa())
+        , m_max_states(std::max<size_t>(max_states, 4))
+        , m_max_flushes(max_flushes)
+        , m_seen(m_nfa.states.size(), 0)
+    {
+        flush();
+    }
+
+    size_t alphabet_size() const { return m_nfa.alphabet_size; }
+
+    const stats& get_stats() const { return m_stats; }
+
+    /**
+     *  \brief Walks the whole input like the 'trie' compiled by 'regex_set::compile'.
+     *  \return true if any pattern matched, 'ids' is the sorted list of the matched patterns.
+     */
+    template<template<typename> class TCont>
+    bool follow(const TCont<event_type>& cnt, id_list& ids)
+    {
+        size_t flushes = 0;
+        row_id row = m_start_row;
+        typename TCont<event_type>::const_iterator it = cnt.cbegin();
+        for (; it != cnt.cend(); ++it) {
+            const size_t ev = details::_event_index(*it);
+            if (ev >= alphabet_size()) {
+                return false;
+            }
+
+            row_id next = m_rows[row].next[ev];
+            if (next != unknown_row) {
+                ++m_stats.hits;
+            } else {
+                ++m_stats.misses;
+                if (m_rows.size() >= m_max_states) {
+                    if (++flushes > m_max_flushes) {
+                        break;
+                    }
+                    // The current row must survive the flush.
+                    set_type cur = m_rows[row].set;
+                    flush();
+                    row = add_row(cur);
+                }
+                m_nfa.step(m_rows[row].set, ev, m_set, m_seen);
+                next = add_row(m_set);
+                m_rows[row].next[ev] = next;
+            }
+            row = next;
+            if (row == dead_row) {
+                return false;
+            }
+        }
+
+        if (it == cnt.cend()) {
+            ids = m_rows[row].accepts;
+            return ! ids.empty();
+        }
+
+        // The cache thrashes, fall back to the NFA simulation.
+        ++m_stats.nfa_fallbacks;
+        set_type set = m_rows[row].set;
+        for (; it != cnt.cend(); ++it) {
+            const size_t ev = details::_event_index(*it);
+            if (ev >= alphabet_size()) {
+                return false;
+            }
+            m_nfa.step(set, ev, m_set, m_seen);
+            std::swap(set, m_set);
+            if (set.empty()) {
+                return false;
+            }
+        }
+        m_nfa.accepts(set, ids);
+        return ! ids.empty();
+    }
+
+    size_t size() const { return m_rows.size(); }
+
+private:
+    row_id add_row(const set_type& set)
+    {
+        typename std::map<set_type, row_id>::const_iterator it = m_ids.find(set);
+        if (it != m_ids.cend()) {
+            return it->second;
+        }
+        const row_id id = (row_id)m_rows.size();
+        m_rows.emplace_back();
+        m_rows.back().set = set;
+        m_rows.back().next.assign(alphabet_size(), unknown_row);
+        m_nfa.accepts(set, m_rows.back().accepts);
+        m_ids.emplace(set, id);
+        return id;
+    }
+
+    void flush()
+    {
+        if (! m_rows.empty()) {
+            ++m_stats.flushes;
+        }
+        m_rows.clear();
+        m_ids.clear();
+
+        add_row(set_type());
+        m_rows[dead_row].next.assign(alphabet_size(), dead_row);
+        m_nfa.start_set(m_set, m_seen);
+        m_start_row = add_row(m_set);
+    }
+
+private:
+    const details::nfa m_nfa;
+    const size_t m_max_states;
+    const size_t m_max_flushes;
+
+    std::vector<row_t> m_rows;
+    std::map<set_type, row_id> m_ids;
+    row_id m_start_row = dead_row;
+    stats m_stats;
+
+    set_type m_set;
+    std::vector<uint8_t> m_seen;
+};
+
+} // namespace fsm
+
+#endif // FSM_LAZY_DFA_H
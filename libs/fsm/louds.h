@@ -0,0 +1,395 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_LOUDS_H
+#define FSM_LOUDS_H
+
+#include <cassert>
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "fsm/trie.h"
+
+namespace fsm {
+namespace details {
+
+/**
+ *  \brief  Bit vector with the rank directory of 512-bit blocks.
+ */
+class bit_vector final
+{
+    static constexpr size_t word_bits = 64;
+    static constexpr size_t block_words = 8;
+    static constexpr size_t block_bits = word_bits * block_words;
+
+public:
+    bool operator[](const size_t pos) const
+    {
+        assert((pos < m_size) && "bit_vector::operator[](): invalid position");
+        return ((m_words[pos / word_bits] >> (pos % word_bits)) & 1u) != 0;
+    }
+
+    /**
+     *  \brief Builds the rank directory, must be called after the last 'push_back'.
+     */
+    void build()
+    {
+        const size_t blocks = (m_words.size() + block_words - 1) / block_words;
+        m_ranks.assign(blocks + 1, 0);
+        size_t ones = 0;
+        for (size_t i = 0; i < m_words.size(); ++i) {
+            if (i % block_words == 0) {
+                m_ranks[i / block_words] = (uint32_t)ones;
+            }
+            ones += (size_t)__builtin_popcountll(m_words[i]);
+        }
+        m_ranks[blocks] = (uint32_t)ones;
+    }
+
+    void clear()
+    {
+        m_words.clear();
+        m_ranks.clear();
+        m_size = 0;
+    }
+
+    size_t memory_size() const { return m_words.size() * sizeof(uint64_t) + m_ranks.size() * sizeof(uint32_t); }
+
+    /**
+     *  \brief Returns the position of the first zero bit at or after 'pos'.
+     */
+    size_t next_zero(const size_t pos) const
+    {
+        size_t i = pos / word_bits;
+        uint64_t word = ~m_words[i] & (~uint64_t(0) << (pos % word_bits));
+        while (word == 0) {
+            word = ~m_words[++i];
+        }
+        return i * word_bits + (size_t)__builtin_ctzll(word);
+    }
+
+    void push_back(const bool bit)
+    {
+        if (m_size % word_bits == 0) {
+            m_words.emplace_back(0);
+        }
+        if (bit) {
+            m_words.back() |= uint64_t(1) << (m_size % word_bits);
+        }
+        ++m_size;
+    }
+
+    /**
+     *  \brief Returns the number of one bits in range [0, pos).
+     */
+    size_t rank1(const size_t pos) const
+    {
+        const size_t word = pos / word_bits;
+        size_t res = m_ranks[word / block_words];
+        for (size_t i = word / block_words * block_words; i < word; ++i) {
+            res += (size_t)__builtin_popcountll(m_words[i]);
+        }
+        if (pos % word_bits != 0) {
+            res += (size_t)__builtin_popcountll(m_words[word] & ((uint64_t(1) << (pos % word_bits)) - 1));
+        }
+        return res;
+    }
+
+    /**
+     *  \brief Returns the position of the zero bit with the index 'idx' (0-based).
+     */
+    size_t select0(size_t idx) const
+    {
+        const auto zeros = [this](const size_t block) { return block * block_bits - m_ranks[block]; };
+
+        // The last block whose preceding zeros do not exceed 'idx'.
+        size_t lo = 0;
+        size_t hi = (m_words.size() + block_words - 1) / block_words;
+        while (hi - lo > 1) {
+            const size_t mid = (lo + hi) / 2;
+            if (zeros(mid) <= idx) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+
+        idx -= zeros(lo);
+        size_t i = lo * block_words;
+        for (;; ++i) {
+            const size_t cnt = word_bits - (size_t)__builtin_popcountll(m_words[i]);
+            if (idx < cnt) {
+                break;
+            }
+            idx -= cnt;
+        }
+        uint64_t word = ~m_words[i];
+        for (; idx > 0; --idx) {
+            word &= word - 1;
+        }
+        return i * word_bits + (size_t)__builtin_ctzll(word);
+    }
+
+    size_t size() const { return m_size; }
+
+    void swap(bit_vector& other)
+    {
+        std::swap(m_words, other.m_words);
+        std::swap(m_ranks, other.m_ranks);
+        std::swap(m_size, other.m_size);
+    }
+
+private:
+    std::vector<uint64_t> m_words;
+    std::vector<uint32_t> m_ranks;
+    size_t m_size = 0;
+};
+
+} // namespace details
+
+/**
+ *  \brief  Read-only succinct representation of the trie (level-order unary degree sequence).
+ *  \details  Nodes are numbered in BFS order. The tree structure takes about 2 bits per node: every
+ *            node is written as one bit per child followed by the zero bit. Labels of incoming
+ *            transitions are stored in the level order, so children of a node are contiguous and
+ *            sorted. The availability of nodes is the separate bit vector, the rank in it is the
+ *            index of the value. The state id is the node number + 1, so 'invalid_state' is 0.
+ *            The source trie must be a tree: automata with shared states or cycles (e.g. 'link'ed
+ *            or minimized ones) are rejected by 'assign'.
+ *  \tparam TValue
+ *  \tparam TTrans
+ */
+template<typename TValue, typename TTrans>
+class louds_trie
+{
+    using louds_trie_type = louds_trie<TValue, TTrans>;
+
+public:
+    using event_type = typename TTrans::event_type;
+    using ptr = std::shared_ptr<louds_trie_type>;
+    using state_id = typename TTrans::state_type;
+    using value_type = TValue;
+
+    static constexpr state_id begin_state = 1u;
+    static constexpr state_id invalid_state = 0u;
+
+    louds_trie() = default;
+
+    /**
+     *  \brief The object is empty if the trie is not a tree (see 'assign').
+     */
+    template<template<typename> class TStateCont, typename TValueCont, typename TStats>
+    explicit louds_trie(const trie<TValue, TTrans, TStateCont, TValueCont, TStats>& other) { assign(other); }
+
+    /**
+     *  \brief Builds the representation of the trie.
+     *  \return false and leaves the object empty if a state of the trie is reachable by more than
+     *          one path.
+     */
+    template<template<typename> class TStateCont, typename TValueCont, typename TStats>
+    bool assign(const trie<TValue, TTrans, TStateCont, TValueCont, TStats>& other)
+    {
+        using trie_state = typename trie<TValue, TTrans, TStateCont, TValueCont, TStats>::state_id;
+
+        clear();
+
+        // Super root.
+        m_tree.push_back(true);
+        m_tree.push_back(false);
+
+        std::vector<bool> is_visited(other.size(), false);
+        std::vector<trie_state> queue(1, other.begin());
+        std::vector<std::pair<event_type, trie_state>> children;
+        m_labels.emplace_back(event_type()); // root has no incoming transition
+        is_visited[other.begin()] = true;
+        for (size_t i = 0; i < queue.size(); ++i) {
+            const trie_state st = queue[i];
+            m_accepts.push_back(other.is_available(st));
+            if (other.is_available(st)) {
+                m_values.emplace_back(other.value(st));
+            }
+
+            children.clear();
+            other.for_each_trans(st, [&children](const event_type& ev, const trie_state& to) {
+                                         children.emplace_back(ev, to);
+                                     });
+            for (const std::pair<event_type, trie_state>& child : children) {
+                if (is_visited[child.second]) {
+                    clear();
+                    return false;
+                }
+                is_visited[child.second] = true;
+                m_tree.push_back(true);
+                m_labels.emplace_back(child.first);
+                queue.emplace_back(child.second);
+            }
+            m_tree.push_back(false);
+        }
+
+        m_tree.build();
+        m_accepts.build();
+        m_labels.shrink_to_fit();
+        m_values.shrink_to_fit();
+        return true;
+    }
+
+    const state_id& begin() const { return begin_state; }
+
+    void clear()
+    {
+        m_tree.clear();
+        m_accepts.clear();
+        m_labels.clear();
+        m_values.clear();
+    }
+
+    state_id follow(const state_id& st, const event_type& ev) const
+    {
+        assert((st != invalid_state) && (st <= size()) && "louds_trie::follow(): invalid state");
+
+        const size_t node = st - 1;
+        const size_t first = m_tree.select0(node) + 1;
+        const size_t last = m_tree.next_zero(first);
+        // There are 'node + 1' zeros before 'first', so the first child is the rest ones.
+        const size_t child = first - node - 1;
+
+        const typename std::vector<event_type>::const_iterator begin = m_labels.cbegin() + child;
+        const typename std::vector<event_type>::const_iterator end = begin + (last - first);
+        const typename std::vector<event_type>::const_iterator it =
+            std::lower_bound(begin, end, ev, [](const event_type& l, const event_type& r) {
+                                 return details::_event_index(l) < details::_event_index(r);
+                             });
+        if ((it == end) || (*it != ev)) {
+            return invalid_state;
+        }
+        return (state_id)(it - m_labels.cbegin() + 1);
+    }
+
+    bool follow(state_id& st, const event_type& ev, value_type& val) const
+    {
+        st = follow(st, ev);
+        if ((st == invalid_state) || (! is_available(st))) {
+            return false;
+        }
+        val = value(st);
+        return true;
+    }
+
+    template<template<typename> class TCont>
+    bool follow(const TCont<event_type>& cnt) const { return is_available(walk(cnt)); }
+
+    template<template<typename> class TCont>
+    bool follow(const TCont<event_type>& cnt, value_type& val) const
+    {
+        const state_id st = walk(cnt);
+        if (! is_available(st)) {
+            return false;
+        }
+        val = value(st);
+        return true;
+    }
+
+    /**
+     *  \brief Calls fn(ev, to) for every transition of the state 'st' in ascending order of events
+     *         as unsigned values, as 'fsm::for_each_trans'.
+     */
+    template<typename TFn>
+    void for_each_trans(const state_id& st, TFn fn) const
+    {
+        assert((st != invalid_state) && (st <= size()) && "louds_trie::for_each_trans(): invalid state");
+
+        const size_t node = st - 1;
+        const size_t first = m_tree.select0(node) + 1;
+        const size_t last = m_tree.next_zero(first);
+        for (size_t child = first - node - 1; child < last - node - 1; ++child) {
+            fn(m_labels[child], (state_id)(child + 1));
+        }
+    }
+
+    const state_id& invalid() const { return invalid_state; }
+
+    bool is_available(const state_id& st) const { return (st != invalid_state) && m_accepts[st - 1]; }
+
+    /**
+     *  \brief Returns the size of the representation in bytes.
+     */
+    size_t memory_size() const
+    {
+        return m_tree.memory_size() + m_accepts.memory_size() + m_labels.size() * sizeof(event_type)
+               + m_values.size() * sizeof(value_type);
+    }
+
+    /**
+     *  \brief Returns the number of nodes.
+     */
+    size_t size() const { return m_accepts.size(); }
+
+    void swap(louds_trie& other)
+    {
+        if (this == &other) {
+            return;
+        }
+        m_tree.swap(other.m_tree);
+        m_accepts.swap(other.m_accepts);
+        std::swap(m_labels, other.m_labels);
+        std::swap(m_values, other.m_values);
+    }
+
+    const value_type& value(const state_id& st) const
+    {
+        assert(is_available(st) && "louds_trie::value(): the state is not available");
+        return m_values[m_accepts.rank1(st - 1)];
+    }
+
+private:
+    template<template<typename> class TCont>
+    state_id walk(const TCont<event_type>& cnt) const
+    {
+        if (size() == 0) {
+            return invalid_state;
+        }
+        state_id st = begin_state;
+        for (const event_type& ev : cnt) {
+            st = follow(st, ev);
+            if (st == invalid_state) {
+                return invalid_state;
+            }
+        }
+        return st;
+    }
+
+private:
+    details::bit_vector m_tree;
+    details::bit_vector m_accepts;
+    std::vector<event_type> m_labels;
+    std::vector<value_type> m_values;
+};
+
+} // namespace fsm
+
+#endif // FSM_LOUDS_H
@@ -0,0 +1,184 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_MAPPED_FILE_H
+#define FSM_MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "fsm/scan.h"
+
+namespace fsm {
+
+/**
+ *  \brief  Read-only memory mapping of the file.
+ */
+class mapped_file final
+{
+public:
+    mapped_file() = default;
+
+    explicit mapped_file(const std::string& path, const int advice = MADV_SEQUENTIAL) { open(path, advice); }
+
+    mapped_file(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other)
+        : m_p_data(std::exchange(other.m_p_data, nullptr))
+        , m_size(std::exchange(other.m_size, 0))
+        , m_is_open(std::exchange(other.m_is_open, false))
+    {}
+
+    ~mapped_file() { close(); }
+
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file& operator=(mapped_file&& other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+        close();
+        m_p_data = std::exchange(other.m_p_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_is_open = std::exchange(other.m_is_open, false);
+        return *this;
+    }
+
+    void close()
+    {
+        if (m_p_data != nullptr) {
+            ::munmap(m_p_data, m_size);
+        }
+        m_p_data = nullptr;
+        m_size = 0;
+        m_is_open = false;
+    }
+
+    const char* data() const { return static_cast<const char*>(m_p_data); }
+
+    /**
+     *  \brief Drops pages of the range from the page cache of the process, e.g. already scanned.
+     */
+    void dont_need(const size_t offset, const size_t len) const { advise(offset, len, MADV_DONTNEED); }
+
+    bool is_open() const { return m_is_open; }
+
+    /**
+     *  \brief Maps the file and applies 'advice' (MADV_SEQUENTIAL by default) to the whole mapping.
+     */
+    bool open(const std::string& path, const int advice = MADV_SEQUENTIAL)
+    {
+        close();
+
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        m_size = (size_t)st.st_size;
+        if (m_size > 0) {
+            void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                m_size = 0;
+                return false;
+            }
+            m_p_data = p;
+            ::madvise(m_p_data, m_size, advice);
+        }
+        ::close(fd);
+        m_is_open = true;
+        return true;
+    }
+
+    size_t size() const { return m_size; }
+
+    /**
+     *  \brief Starts the asynchronous readahead of the range.
+     */
+    void will_need(const size_t offset, const size_t len) const { advise(offset, len, MADV_WILLNEED); }
+
+private:
+    void advise(const size_t offset, const size_t len, const int advice) const
+    {
+        if ((m_p_data == nullptr) || (offset >= m_size)) {
+            return;
+        }
+        const size_t page_size = (size_t)::sysconf(_SC_PAGESIZE);
+        const size_t begin = offset / page_size * page_size;
+        const size_t end = std::min(m_size, offset + len);
+        ::madvise(static_cast<char*>(m_p_data) + begin, end - begin, advice);
+    }
+
+private:
+    void* m_p_data = nullptr;
+    size_t m_size = 0;
+    bool m_is_open = false;
+};
+
+/**
+ *  \brief Scans the file (see 'scan') directly from the memory mapping without copying.
+ *  \details  The file is processed by windows of 'readahead' bytes: the readahead of the next
+ *            window is requested before the current one is scanned, and pages of the scanned
+ *            window are dropped after it, so the resident set stays about two windows.
+ *            For the multi-threaded scan pass 'mapped_file::data()' to 'parallel_scan'.
+ *  \return false if the file can not be mapped.
+ */
+template<typename TFsm, typename TFn>
+bool scan_file(const TFsm& fsm, const std::string& path, TFn&& fn, const size_t readahead = 4 << 20)
+{
+    static_assert(sizeof(typename TFsm::event_type) == 1, "fsm::scan_file(): events must be bytes");
+
+    const mapped_file file(path);
+    if (! file.is_open()) {
+        return false;
+    }
+
+    const typename TFsm::event_type* p_data = reinterpret_cast<const typename TFsm::event_type*>(file.data());
+    const size_t window = std::max<size_t>(readahead, 1);
+    file.will_need(0, window);
+    for (size_t first = 0; first < file.size(); first += window) {
+        const size_t last = std::min(file.size(), first + window);
+        file.will_need(last, window);
+        scan(fsm, p_data, file.size(), first, last, fn);
+        file.dont_need(first, last - first);
+    }
+    return true;
+}
+
+} // namespace fsm
+
+#endif // FSM_MAPPED_FILE_H
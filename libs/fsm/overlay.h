@@ -0,0 +1,188 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_OVERLAY_H
+#define FSM_OVERLAY_H
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+#include "fsm/trie.h"
+
+namespace fsm {
+
+/**
+ *  \brief  Frozen base trie with a small mutable delta on top of it.
+ *  \details  New keys go to the delta, lookups consult the delta first and then the base. 'merge'
+ *            moves the delta to the new base image and atomically replaces the old one, lookups
+ *            are not blocked during the merge. Lookups and inserts are thread-safe.
+ *  \tparam TValue
+ *  \tparam TTrans
+ *  \tparam TStateCont
+ */
+template<typename TValue, typename TTrans, template<typename> class TStateCont = std::vector>
+class overlay
+{
+public:
+    using event_type = typename TTrans::event_type;
+    using trie_type = trie<TValue, TTrans, TStateCont>;
+    using value_type = TValue;
+
+private:
+    using key_type = std::vector<event_type>;
+    using trie_ptr = std::shared_ptr<const trie_type>;
+
+    struct delta_t final
+    {
+        trie_type trie;
+        std::vector<std::pair<key_type, value_type>> log;
+    };
+
+    using delta_ptr = std::shared_ptr<const delta_t>;
+
+    struct snapshot_t final
+    {
+        trie_ptr base;
+        // The delta being merged to the base, it is consulted until the merge is published.
+        delta_ptr merging;
+    };
+
+    using snapshot_ptr = std::shared_ptr<const snapshot_t>;
+
+public:
+    using ptr = std::shared_ptr<overlay<TValue, TTrans, TStateCont>>;
+
+    overlay()
+        : overlay(trie_type())
+    {}
+
+    explicit overlay(trie_type base)
+        : m_snapshot(std::make_shared<snapshot_t>(snapshot_t{std::make_shared<trie_type>(std::move(base)),
+                                                             delta_ptr()}))
+        , m_delta(std::make_shared<delta_t>())
+    {}
+
+    overlay(const overlay&) = delete;
+    overlay& operator=(const overlay&) = delete;
+
+    /**
+     *  \brief Returns the current base image.
+     */
+    trie_ptr base() const { return std::atomic_load(&m_snapshot)->base; }
+
+    size_t delta_size() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_delta_mutex);
+        return m_delta->log.size();
+    }
+
+    template<template<typename> class TCont>
+    bool follow(const TCont<event_type>& cnt) const
+    {
+        value_type val;
+        return follow(cnt, val);
+    }
+
+    template<template<typename> class TCont>
+    bool follow(const TCont<event_type>& cnt, value_type& val) const
+    {
+        snapshot_ptr p_snapshot;
+        {
+            std::shared_lock<std::shared_mutex> lock(m_delta_mutex);
+            if (m_delta->trie.follow(cnt, val)) {
+                return true;
+            }
+            // The snapshot is loaded under the lock, so a key moved from the delta by 'merge'
+            // is found in 'merging'.
+            p_snapshot = std::atomic_load(&m_snapshot);
+        }
+        if (p_snapshot->merging && p_snapshot->merging->trie.follow(cnt, val)) {
+            return true;
+        }
+        return p_snapshot->base->follow(cnt, val);
+    }
+
+    template<template<typename> class TCont>
+    bool insert(const TCont<event_type>& cnt, const value_type& val)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_delta_mutex);
+        m_delta->log.emplace_back(key_type(cnt.begin(), cnt.end()), val);
+        return m_delta->trie.insert(cnt, val);
+    }
+
+    /**
+     *  \brief Merges the delta to the new base image and publishes it.
+     *  \param is_relayout - relayout the new base image (see 'trie::relayout').
+     */
+    void merge(const bool is_relayout = true)
+    {
+        std::lock_guard<std::mutex> merge_lock(m_merge_mutex);
+
+        delta_ptr p_merging;
+        trie_ptr p_base;
+        {
+            std::unique_lock<std::shared_mutex> lock(m_delta_mutex);
+            if (m_delta->log.empty()) {
+                return;
+            }
+            p_merging = std::move(m_delta);
+            m_delta = std::make_shared<delta_t>();
+            p_base = std::atomic_load(&m_snapshot)->base;
+            std::atomic_store(&m_snapshot, std::make_shared<const snapshot_t>(snapshot_t{p_base, p_merging}));
+        }
+
+        std::shared_ptr<trie_type> p_new_base = std::make_shared<trie_type>(*p_base);
+        for (const std::pair<key_type, value_type>& kv : p_merging->log) {
+            p_new_base->insert(kv.first, kv.second);
+        }
+        if (is_relayout) {
+            p_new_base->relayout();
+        }
+        std::atomic_store(&m_snapshot, std::make_shared<const snapshot_t>(snapshot_t{p_new_base, delta_ptr()}));
+    }
+
+    /**
+     *  \brief Runs 'merge' in the background thread.
+     */
+    std::future<void> merge_async(const bool is_relayout = true)
+    {
+        return std::async(std::launch::async, [this, is_relayout]() { merge(is_relayout); });
+    }
+
+private:
+    snapshot_ptr m_snapshot;
+
+    mutable std::shared_mutex m_delta_mutex;
+    std::shared_ptr<delta_t> m_delta;
+
+    std::mutex m_merge_mutex;
+};
+
+} // namespace fsm
+
+#endif // FSM_OVERLAY_H
@@ -0,0 +1,300 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_POOL_H
+#define FSM_POOL_H
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "fsm/fsm.h"
+
+namespace fsm {
+
+/**
+ *  \brief  Registry of many tenant dictionaries stored in one shared minimized state arena.
+ *  \details  Keys are staged per tenant by 'insert' and moved to the arena by 'commit'. During
+ *            the commit equal suffix subtrees are merged across all tenants, so dictionaries with
+ *            common entries share their states. Every tenant is represented by its root state.
+ *            The commit rebuilds the arena from the live tenants, so the states of re-committed
+ *            tenants are freed and the arena is kept minimal. The states of erased tenants are
+ *            freed by the next 'commit' or 'compact'.
+ *  \tparam TTenant
+ *  \tparam TTrans
+ *  \tparam TStateCont
+ *  \tparam TRootCont
+ */
+template<typename TTenant, typename TTrans, template<typename> class TStateCont = std::vector,
+         typename TRootCont = std::map<TTenant, typename TTrans::state_type>>
+class pool
+{
+    using fsm_type = fsm<TTrans, TStateCont>;
+    using pool_type = pool<TTenant, TTrans, TStateCont, TRootCont>;
+    using root_list = TRootCont;
+    using staged_list = std::map<TTenant, fsm_type>;
+    using signature = std::pair<bool, std::vector<std::pair<typename TTrans::event_type,
+                                                            typename TTrans::state_type>>>;
+    using register_type = std::map<signature, typename TTrans::state_type>;
+
+public:
+    using event_type = typename fsm_type::event_type;
+    using ptr = std::shared_ptr<pool_type>;
+    using state_id = typename fsm_type::state_id;
+    using tenant_type = TTenant;
+
+    pool()
+        : m_arena()
+    {}
+
+    pool(const pool& other)
+        : m_arena(other.m_arena)
+        , m_roots(other.m_roots)
+        , m_staged(other.m_staged)
+        , m_register(other.m_register)
+    {}
+
+    pool(pool&& other)
+        : m_arena(std::move(other.m_arena))
+        , m_roots(std::move(other.m_roots))
+        , m_staged(std::move(other.m_staged))
+        , m_register(std::move(other.m_register))
+    {}
+
+    pool& operator=(const pool& other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+        m_arena = other.m_arena;
+        m_roots = other.m_roots;
+        m_staged = other.m_staged;
+        m_register = other.m_register;
+        return *this;
+    }
+
+    pool& operator=(pool&& other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+        swap(other);
+        return *this;
+    }
+
+    void clear()
+    {
+        m_arena = fsm_type();
+        m_roots.clear();
+        m_staged.clear();
+        m_register.clear();
+    }
+
+    /**
+     *  \brief Moves all staged keys to the shared arena.
+     *  \details  The live tenants are re-interned to the new arena, so the commit takes the time
+     *            proportional to the size of the arena, not only of the staged keys.
+     */
+    void commit()
+    {
+        if (m_staged.empty()) {
+            return;
+        }
+
+        // Keys of the re-committed tenants are merged to the staged ones before the old arena is dropped.
+        for (typename staged_list::iterator it = m_staged.begin(); it != m_staged.end(); ++it) {
+            typename root_list::iterator root_it = m_roots.find(it->first);
+            if (root_it != m_roots.end()) {
+                unfold(root_it->second, it->second, it->second.begin());
+                m_roots.erase(root_it);
+            }
+        }
+        rebuild();
+
+        for (typename staged_list::iterator it = m_staged.begin(); it != m_staged.end(); ++it) {
+            std::vector<state_id> ids(it->second.size(), invalid());
+            m_roots[it->first] = intern(it->second, it->second.begin(), ids);
+        }
+        m_staged.clear();
+        register_type().swap(m_register);
+    }
+
+    /**
+     *  \brief Frees the states of the erased tenants.
+     */
+    void compact()
+    {
+        rebuild();
+        register_type().swap(m_register);
+    }
+
+    bool erase(const tenant_type& tenant)
+    {
+        m_staged.erase(tenant);
+        return (m_roots.erase(tenant) > 0);
+    }
+
+    state_id follow(const state_id& st, const event_type& ev) const { return m_arena.follow(st, ev); }
+
+    template<template<typename> class TCont>
+    bool follow(const tenant_type& tenant, const TCont<event_type>& cnt) const
+    {
+        state_id st = root(tenant);
+        if (st == invalid()) {
+            return false;
+        }
+        for (const event_type& ev : cnt) {
+            st = m_arena.follow(st, ev);
+            if (st == invalid()) {
+                return false;
+            }
+        }
+        return m_arena.is_available(st);
+    }
+
+    /**
+     *  \brief Stages the key for the tenant. The key becomes visible after 'commit'.
+     */
+    template<template<typename> class TCont>
+    bool insert(const tenant_type& tenant, const TCont<event_type>& cnt) { return m_staged[tenant].insert(cnt); }
+
+    const state_id& invalid() const { return m_arena.invalid(); }
+
+    bool is_available(const state_id& st) const { return m_arena.is_available(st); }
+
+    state_id root(const tenant_type& tenant) const
+    {
+        typename root_list::const_iterator it = m_roots.find(tenant);
+        return (it != m_roots.cend()) ? it->second : invalid();
+    }
+
+    size_t size() const { return m_arena.size(); }
+
+    void swap(pool& other)
+    {
+        if (this == &other) {
+            return;
+        }
+        m_arena.swap(other.m_arena);
+        std::swap(m_roots, other.m_roots);
+        std::swap(m_staged, other.m_staged);
+        std::swap(m_register, other.m_register);
+    }
+
+    size_t tenants_count() const { return m_roots.size(); }
+
+private:
+    /**
+     *  \brief Interns the subtree of 'st' bottom-up, children are interned before their parent.
+     *  \param ids - ids of the already interned states of 'src' or 'invalid()'.
+     */
+    state_id intern(const fsm_type& src, const state_id& st, std::vector<state_id>& ids)
+    {
+        std::vector<std::pair<state_id, bool>> stack(1, std::make_pair(st, false));
+        while (! stack.empty()) {
+            const std::pair<state_id, bool> top = stack.back();
+            stack.pop_back();
+            if (ids[top.first] != invalid()) {
+                continue;
+            }
+            if (! top.second) {
+                stack.emplace_back(top.first, true);
+                src.for_each_trans(top.first, [&stack](const event_type&, const state_id& to) {
+                                                  stack.emplace_back(to, false);
+                                              });
+                continue;
+            }
+
+            signature sig;
+            sig.first = src.is_available(top.first);
+            src.for_each_trans(top.first, [&ids, &sig](const event_type& ev, const state_id& to) {
+                                              sig.second.emplace_back(ev, ids[to]);
+                                          });
+
+            typename register_type::const_iterator it = m_register.find(sig);
+            if (it != m_register.cend()) {
+                ids[top.first] = it->second;
+                continue;
+            }
+
+            const state_id id = m_arena.make_state_id();
+            if (sig.first) {
+                m_arena.make_available(id);
+            }
+            for (const std::pair<event_type, state_id>& tr : sig.second) {
+                m_arena.link(id, tr.first, tr.second);
+            }
+            m_register.emplace(std::move(sig), id);
+            ids[top.first] = id;
+        }
+        return ids[st];
+    }
+
+    /**
+     *  \brief Re-interns the committed tenants to the new arena, unreachable states are dropped.
+     */
+    void rebuild()
+    {
+        fsm_type arena;
+        arena.swap(m_arena);
+        m_register.clear();
+
+        std::vector<state_id> ids(arena.size(), invalid());
+        for (typename root_list::iterator it = m_roots.begin(); it != m_roots.end(); ++it) {
+            it->second = intern(arena, it->second, ids);
+        }
+    }
+
+    /**
+     *  \brief Copies the keys of the arena state 'from' to the state 'dst_from' of 'dst'.
+     */
+    void unfold(const state_id& from, fsm_type& dst, const state_id& dst_from) const
+    {
+        std::vector<std::pair<state_id, state_id>> stack(1, std::make_pair(from, dst_from));
+        while (! stack.empty()) {
+            const std::pair<state_id, state_id> top = stack.back();
+            stack.pop_back();
+            if (m_arena.is_available(top.first)) {
+                dst.make_available(top.second);
+            }
+            m_arena.for_each_trans(top.first, [&dst, &stack, &top](const event_type& ev, const state_id& to) {
+                                                  state_id dst_to = dst.follow(top.second, ev);
+                                                  if (dst_to == dst.invalid()) {
+                                                      dst_to = dst.insert(top.second, ev, false);
+                                                  }
+                                                  stack.emplace_back(to, dst_to);
+                                              });
+        }
+    }
+
+private:
+    fsm_type m_arena;
+    root_list m_roots;
+    staged_list m_staged;
+    register_type m_register;
+};
+
+} // namespace fsm
+
+#endif // FSM_POOL_H
@@ -0,0 +1,709 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_REGEX_H
+#define FSM_REGEX_H
+
+#include <cctype>
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fsm/trie.h"
+
+namespace fsm {
+namespace details {
+
+constexpr size_t max_alphabet_size = 256;
+constexpr size_t npos = (size_t)-1;
+
+using event_class = std::bitset<max_alphabet_size>;
+
+/**
+ *  \brief  Thompson NFA over event indices.
+ */
+class nfa final
+{
+public:
+    struct state_t final
+    {
+        std::vector<size_t> eps;
+        event_class cls;
+        size_t next = npos;
+        size_t accept = npos;
+    };
+
+    size_t add_state()
+    {
+        states.emplace_back();
+        return states.size() - 1;
+    }
+
+    /**
+     *  \brief Expands the set by epsilon transitions and sorts it.
+     *  \param seen - scratch buffer, it must be zeroed and have 'states.size()' elements.
+     */
+    void closure(std::vector<size_t>& set, std::vector<uint8_t>& seen) const
+    {
+        std::vector<size_t> stack(set);
+        set.clear();
+        while (! stack.empty()) {
+            const size_t st = stack.back();
+            stack.pop_back();
+            if (seen[st] != 0) {
+                continue;
+            }
+            seen[st] = 1;
+            set.emplace_back(st);
+            stack.insert(stack.end(), states[st].eps.cbegin(), states[st].eps.cend());
+        }
+        for (const size_t st : set) {
+            seen[st] = 0;
+        }
+        std::sort(set.begin(), set.end());
+    }
+
+    void start_set(std::vector<size_t>& res, std::vector<uint8_t>& seen) const
+    {
+        res = starts;
+        closure(res, seen);
+    }
+
+    void step(const std::vector<size_t>& set, const size_t ev, std::vector<size_t>& res,
+              std::vector<uint8_t>& seen) const
+    {
+        res.clear();
+        for (const size_t st : set) {
+            if ((states[st].next != npos) && states[st].cls.test(ev)) {
+                res.emplace_back(states[st].next);
+            }
+        }
+        closure(res, seen);
+    }
+
+    void accepts(const std::vector<size_t>& set, std::vector<size_t>& ids) const
+    {
+        ids.clear();
+        for (const size_t st : set) {
+            if (states[st].accept != npos) {
+                ids.emplace_back(states[st].accept);
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+
+    size_t alphabet_size = max_alphabet_size;
+    std::vector<state_t> states;
+    std::vector<size_t> starts;
+};
+
+/**
+ *  \brief  Recursive descent parser of the pattern to the Thompson NFA.
+ *  \details  Every fragment has a single entry and a single exit state, the exit state has no
+ *            transitions yet.
+ */
+class regex_parser final
+{
+    using fragment = std::pair<size_t, size_t>;
+
+public:
+    regex_parser(nfa& automaton, const std::string& pattern)
+        : m_nfa(automaton)
+        , m_pattern(pattern)
+        , m_all(make_all(automaton.alphabet_size))
+    {}
+
+    bool parse(const size_t id)
+    {
+        const bool anchor_begin = eat('^');
+        fragment body;
+        if (! parse_alt(body)) {
+            return false;
+        }
+        const bool anchor_end = eat('$');
+        if (m_pos != m_pattern.size()) {
+            return false;
+        }
+
+        size_t entry = body.first;
+        if (! anchor_begin) {
+            entry = m_nfa.add_state();
+            m_nfa.states[entry].cls = m_all;
+            m_nfa.states[entry].next = entry;
+            m_nfa.states[entry].eps.emplace_back(body.first);
+        }
+        if (! anchor_end) {
+            m_nfa.states[body.second].cls = m_all;
+            m_nfa.states[body.second].next = body.second;
+        }
+        m_nfa.states[body.second].accept = id;
+        m_nfa.starts.emplace_back(entry);
+        return true;
+    }
+
+private:
+    static event_class make_all(const size_t alphabet_size)
+    {
+        event_class cls;
+        for (size_t i = 0; i < alphabet_size; ++i) {
+            cls.set(i);
+        }
+        return cls;
+    }
+
+    bool at_end() const { return m_pos >= m_pattern.size(); }
+
+    bool eat(const char ch)
+    {
+        if (! at_end() && (m_pattern[m_pos] == ch)) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    size_t peek() const { return (unsigned char)m_pattern[m_pos]; }
+
+    static bool is_quantifier(const size_t ch) { return (ch == '*') || (ch == '+') || (ch == '?') || (ch == '{'); }
+
+    fragment make_class(const event_class& cls)
+    {
+        const size_t from = m_nfa.add_state();
+        const size_t to = m_nfa.add_state();
+        m_nfa.states[from].cls = cls & m_all;
+        m_nfa.states[from].next = to;
+        return fragment(from, to);
+    }
+
+    fragment make_empty()
+    {
+        const size_t st = m_nfa.add_state();
+        return fragment(st, st);
+    }
+
+    void link(const size_t from, const size_t to) { m_nfa.states[from].eps.emplace_back(to); }
+
+    bool parse_alt(fragment& res)
+    {
+        if (! parse_concat(res)) {
+            return false;
+        }
+        while (eat('|')) {
+            fragment other;
+            if (! parse_concat(other)) {
+                return false;
+            }
+            const size_t from = m_nfa.add_state();
+            const size_t to = m_nfa.add_state();
+            link(from, res.first);
+            link(from, other.first);
+            link(res.second, to);
+            link(other.second, to);
+            res = fragment(from, to);
+        }
+        return true;
+    }
+
+    bool parse_concat(fragment& res)
+    {
+        res = make_empty();
+        while (! at_end() && (peek() != '|') && (peek() != ')') && (peek() != '$')) {
+            fragment next;
+            if (! parse_repeat(next)) {
+                return false;
+            }
+            link(res.second, next.first);
+            res.second = next.second;
+        }
+        return true;
+    }
+
+    bool parse_repeat(fragment& res)
+    {
+        const size_t atom_pos = m_pos;
+        if (! parse_atom(res)) {
+            return false;
+        }
+        if (at_end()) {
+            return true;
+        }
+        if (eat('*')) {
+            res = make_star(res);
+        } else if (eat('+')) {
+            link(res.second, res.first);
+            const size_t to = m_nfa.add_state();
+            link(res.second, to);
+            res.second = to;
+        } else if (eat('?')) {
+            const size_t from = m_nfa.add_state();
+            link(from, res.first);
+            link(from, res.second);
+            res.first = from;
+        } else if (peek() == '{') {
+            size_t min = 0;
+            size_t max = 0;
+            if (! parse_bounds(min, max)) {
+                return false;
+            }
+            const size_t end_pos = m_pos;
+            if (! make_bounded(atom_pos, end_pos, min, max, res)) {
+                return false;
+            }
+            m_pos = end_pos;
+        } else {
+            return true;
+        }
+        // Stacked quantifiers (e.g. 'a{2}{3}' or lazy 'a*?') are rejected as by ECMAScript.
+        return at_end() || ! is_quantifier(peek());
+    }
+
+    fragment make_star(const fragment& frag)
+    {
+        const size_t from = m_nfa.add_state();
+        const size_t to = m_nfa.add_state();
+        link(from, frag.first);
+        link(from, to);
+        link(frag.second, frag.first);
+        link(frag.second, to);
+        return fragment(from, to);
+    }
+
+    bool parse_bounds(size_t& min, size_t& max)
+    {
+        ++m_pos; // '{'
+        if (! parse_number(min)) {
+            return false;
+        }
+        max = min;
+        if (eat(',')) {
+            max = npos;
+            if (! at_end() && (peek() != '}') && ! parse_number(max)) {
+                return false;
+            }
+        }
+        return eat('}') && (min <= max);
+    }
+
+    bool parse_number(size_t& res)
+    {
+        const size_t begin = m_pos;
+        res = 0;
+        while (! at_end() && (peek() >= '0') && (peek() <= '9') && (m_pos - begin < 4)) {
+            res = res * 10 + (peek() - '0');
+            ++m_pos;
+        }
+        return (m_pos != begin);
+    }
+
+    /**
+     *  \brief Builds 'atom{min,max}' by parsing the atom again for every copy.
+     */
+    bool make_bounded(const size_t atom_pos, const size_t end_pos, const size_t min, const size_t max,
+                      fragment& res)
+    {
+        const fragment first = res;
+        const size_t copies = (max == npos) ? std::max<size_t>(min, 1) : max;
+        std::vector<fragment> frags(1, first);
+        for (size_t i = 1; i < copies; ++i) {
+            m_pos = atom_pos;
+            fragment frag;
+            if (! parse_atom(frag)) {
+                return false;
+            }
+            frags.emplace_back(frag);
+        }
+        m_pos = end_pos;
+
+        if (max == npos) {
+            // The last copy is repeated any number of times.
+            if (min == 0) {
+                res = make_star(frags.back());
+                return true;
+            }
+            // As for '+' the exit is the new state, so the skips to the exit of the fragment
+            // (e.g. by '?') do not enter the loop.
+            const size_t to = m_nfa.add_state();
+            link(frags.back().second, frags.back().first);
+            link(frags.back().second, to);
+            frags.back().second = to;
+        }
+
+        res = make_empty();
+        for (size_t i = 0; i < frags.size(); ++i) {
+            if ((i >= min) && (max != npos)) {
+                link(res.second, frags.back().second);
+            }
+            link(res.second, frags[i].first);
+            res.second = frags[i].second;
+        }
+        if (min == 0 && max == 0) {
+            res = make_empty();
+        }
+        return true;
+    }
+
+    bool parse_atom(fragment& res)
+    {
+        if (at_end()) {
+            return false;
+        }
+        const char ch = m_pattern[m_pos++];
+        event_class cls;
+        switch (ch) {
+        case '(':
+            if (! parse_alt(res)) {
+                return false;
+            }
+            return eat(')');
+        case '[':
+            if (! parse_class(cls)) {
+                return false;
+            }
+            res = make_class(cls);
+            return true;
+        case '.':
+            cls = m_all;
+            cls.reset('\n');
+            res = make_class(cls);
+            return true;
+        case '\\':
+            if (! parse_escape(cls)) {
+                return false;
+            }
+            res = make_class(cls);
+            return true;
+        case ')': case '*': case '+': case '?': case '{': case '}': case ']': case '|': case '^': case '$':
+            return false;
+        default:
+            cls.set((unsigned char)ch);
+            res = make_class(cls);
+            return true;
+        }
+    }
+
+    bool parse_escape(event_class& cls)
+    {
+        if (at_end()) {
+            return false;
+        }
+        const char ch = m_pattern[m_pos++];
+        switch (ch) {
+        case 'd': case 'D':
+            set_range(cls, '0', '9');
+            break;
+        case 'w': case 'W':
+            set_range(cls, '0', '9');
+            set_range(cls, 'a', 'z');
+            set_range(cls, 'A', 'Z');
+            cls.set('_');
+            break;
+        case 's': case 'S':
+            for (const char sp : std::string(" \t\n\r\f\v")) {
+                cls.set((unsigned char)sp);
+            }
+            break;
+        case 'n': cls.set('\n'); return true;
+        case 't': cls.set('\t'); return true;
+        case 'r': cls.set('\r'); return true;
+        case 'x': {
+            size_t val = 0;
+            for (size_t i = 0; i < 2; ++i) {
+                if (at_end() || ! std::isxdigit(peek())) {
+                    return false;
+                }
+                const char hex = m_pattern[m_pos++];
+                val = val * 16 + (std::isdigit((unsigned char)hex) ? (hex - '0') : (std::tolower(hex) - 'a' + 10));
+            }
+            cls.set(val);
+            return true;
+        }
+        default:
+            if (std::isalnum((unsigned char)ch)) {
+                return false;
+            }
+            cls.set((unsigned char)ch);
+            return true;
+        }
+        if (std::isupper((unsigned char)ch)) {
+            cls = ~cls & m_all;
+        }
+        return true;
+    }
+
+    bool parse_class(event_class& cls)
+    {
+        const bool is_negative = eat('^');
+        bool is_first = true;
+        while (! at_end() && ((peek() != ']') || is_first)) {
+            is_first = false;
+            event_class item;
+            size_t from = peek();
+            if (eat('\\')) {
+                if (! parse_escape(item)) {
+                    return false;
+                }
+                from = (item.count() == 1) ? find_first(item) : npos;
+            } else {
+                ++m_pos;
+                item.set(from);
+            }
+
+            if ((from != npos) && (m_pos + 1 < m_pattern.size()) && (peek() == '-') &&
+                (m_pattern[m_pos + 1] != ']')) {
+                ++m_pos; // '-'
+                event_class last_item;
+                size_t to = peek();
+                if (eat('\\')) {
+                    if (! parse_escape(last_item) || (last_item.count() != 1)) {
+                        return false;
+                    }
+                    to = find_first(last_item);
+                } else {
+                    ++m_pos;
+                }
+                if (to < from) {
+                    return false;
+                }
+                set_range(item, from, to);
+            }
+            cls |= item;
+        }
+        if (! eat(']')) {
+            return false;
+        }
+        if (is_negative) {
+            cls = ~cls;
+        }
+        cls &= m_all;
+        return true;
+    }
+
+    static size_t find_first(const event_class& cls)
+    {
+        for (size_t i = 0; i < cls.size(); ++i) {
+            if (cls.test(i)) {
+                return i;
+            }
+        }
+        return npos;
+    }
+
+    static void set_range(event_class& cls, const size_t from, const size_t to)
+    {
+        for (size_t i = from; i <= to; ++i) {
+            cls.set(i);
+        }
+    }
+
+private:
+    nfa& m_nfa;
+    const std::string& m_pattern;
+    const event_class m_all;
+    size_t m_pos = 0;
+};
+
+template<typename TTrans>
+constexpr size_t _default_alphabet_size()
+{
+    if constexpr (TTrans::is_flat) {
+        return std::min(std::tuple_size<typename TTrans::table_type>::value, max_alphabet_size);
+    } else {
+        return max_alphabet_size;
+    }
+}
+
+} // namespace details
+
+/**
+ *  \brief  Compiler of the set of regular expressions to the DFA.
+ *  \details  Supported syntax: literals, '.', classes '[a-z]', '[^...]', escapes '\d', '\w', '\s'
+ *            (and negated '\D', '\W', '\S'), '\n', '\t', '\r', '\xHH', grouping '(...)',
+ *            alternation '|', repetition '*', '+', '?', '{m}', '{m,}', '{m,n}' (one per atom, lazy
+ *            quantifiers are not supported) and anchors '^' at the beginning and '$' at the end
+ *            of the pattern.
+ *            The compiled automaton is walked over the whole input: the input is accepted if any
+ *            pattern matches it, the value of the final state is the sorted list of ids of the
+ *            matched patterns. A pattern without '^' may start at any position, a pattern
+ *            without '$' may end at any position.
+ *            Events are indices in [0, alphabet_size()).
+ *  \tparam TTrans
+ *  \tparam TStateCont
+ */
+template<typename TTrans, template<typename> class TStateCont = std::vector>
+class regex_set
+{
+public:
+    using event_type = typename TTrans::event_type;
+    using id_list = std::vector<size_t>;
+    using state_id = typename TTrans::state_type;
+    using trie_type = trie<id_list, TTrans, TStateCont>;
+
+    explicit regex_set(const size_t alphabet_size = details::_default_alphabet_size<TTrans>())
+    {
+        m_nfa.alphabet_size = std::min(alphabet_size, details::max_alphabet_size);
+    }
+
+    /**
+     *  \brief Adds the pattern with the id.
+     *  \return false on the syntax error, the pattern is not added in this case.
+     */
+    bool add(const std::string& pattern, const size_t id)
+    {
+        const size_t states_count = m_nfa.states.size();
+        details::regex_parser parser(m_nfa, pattern);
+        if (! parser.parse(id)) {
+            m_nfa.states.resize(states_count);
+            return false;
+        }
+        ++m_size;
+        return true;
+    }
+
+    size_t alphabet_size() const { return m_nfa.alphabet_size; }
+
+    void clear()
+    {
+        m_nfa.states.clear();
+        m_nfa.starts.clear();
+        m_size = 0;
+    }
+
+    /**
+     *  \brief Builds the minimal DFA by the subset construction and Moore's partition refinement.
+     */
+    trie_type compile() const
+    {
+        const size_t alphabet = m_nfa.alphabet_size;
+        std::vector<uint8_t> seen(m_nfa.states.size(), 0);
+
+        // Subset construction. DFA state 0 is the dead state.
+        std::map<std::vector<size_t>, size_t> ids;
+        std::vector<std::vector<size_t>> sets(1);
+        std::vector<std::vector<size_t>> delta(1, std::vector<size_t>(alphabet, 0));
+        std::vector<size_t> set;
+        m_nfa.start_set(set, seen);
+        ids.emplace(std::vector<size_t>(), 0);
+        ids.emplace(set, 1);
+        sets.emplace_back(set);
+        delta.emplace_back(alphabet, 0);
+
+        std::vector<size_t> next;
+        for (size_t i = 1; i < sets.size(); ++i) {
+            for (size_t ev = 0; ev < alphabet; ++ev) {
+                m_nfa.step(sets[i], ev, next, seen);
+                std::map<std::vector<size_t>, size_t>::const_iterator it = ids.find(next);
+                if (it == ids.cend()) {
+                    it = ids.emplace(next, sets.size()).first;
+                    sets.emplace_back(next);
+                    delta.emplace_back(alphabet, 0);
+                }
+                delta[i][ev] = it->second;
+            }
+        }
+
+        // Minimization. Initial blocks are the lists of the accepted patterns.
+        std::vector<id_list> accepts(sets.size());
+        std::vector<size_t> block(sets.size(), 0);
+        size_t blocks_count = 0;
+        {
+            std::map<id_list, size_t> initial;
+            for (size_t i = 0; i < sets.size(); ++i) {
+                m_nfa.accepts(sets[i], accepts[i]);
+                block[i] = initial.emplace(accepts[i], initial.size()).first->second;
+            }
+            blocks_count = initial.size();
+        }
+        while (true) {
+            std::map<std::vector<size_t>, size_t> refined;
+            std::vector<size_t> new_block(sets.size(), 0);
+            std::vector<size_t> sig(alphabet + 1, 0);
+            for (size_t i = 0; i < sets.size(); ++i) {
+                sig[0] = block[i];
+                for (size_t ev = 0; ev < alphabet; ++ev) {
+                    sig[ev + 1] = block[delta[i][ev]];
+                }
+                new_block[i] = refined.emplace(sig, refined.size()).first->second;
+            }
+            std::swap(block, new_block);
+            if (refined.size() == blocks_count) {
+                break;
+            }
+            blocks_count = refined.size();
+        }
+
+        // Emission. The dead block is the invalid state, the start block is the begin state.
+        trie_type res;
+        std::vector<state_id> states(blocks_count, res.invalid());
+        std::vector<size_t> repr(blocks_count, details::npos);
+        for (size_t i = 0; i < sets.size(); ++i) {
+            if (repr[block[i]] == details::npos) {
+                repr[block[i]] = i;
+            }
+        }
+        if (block[1] != block[0]) {
+            states[block[1]] = res.begin();
+        }
+        for (size_t b = 0; b < blocks_count; ++b) {
+            if ((b != block[0]) && (b != block[1])) {
+                states[b] = res.make_state_id();
+            }
+        }
+        for (size_t b = 0; b < blocks_count; ++b) {
+            if (states[b] == res.invalid()) {
+                continue;
+            }
+            const size_t i = repr[b];
+            for (size_t ev = 0; ev < alphabet; ++ev) {
+                const state_id to = states[block[delta[i][ev]]];
+                if (to != res.invalid()) {
+                    res.link(states[b], static_cast<event_type>(ev), to);
+                }
+            }
+            if (! accepts[i].empty()) {
+                res.make_available(states[b]);
+                res.set_value(states[b], accepts[i]);
+            }
+        }
+        return res;
+    }
+
+    const details::nfa& nfa() const { return m_nfa; }
+
+    size_t size() const { return m_size; }
+
+private:
+    details::nfa m_nfa;
+    size_t m_size = 0;
+};
+
+} // namespace fsm
+
+#endif // FSM_REGEX_H
@@ -0,0 +1,191 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_REVERSE_H
+#define FSM_REVERSE_H
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "fsm/fsm.h"
+
+namespace fsm {
+
+/**
+ *  \brief  Automaton of reversed keys for suffix queries.
+ *  \details  Keys are inserted from the last event to the first one and the input is consumed
+ *            right-to-left from a bidirectional iterator pair, so queries do not copy or reverse
+ *            the input. The 'boundary' overloads accept only suffixes that are the whole input or
+ *            are preceded by the boundary event, e.g. '.' for domain labels: the key "example.com"
+ *            matches "www.example.com" and not "badexample.com". The input may contain any
+ *            bytes: events out of the alphabet stop the walk like a missing transition.
+ *  \tparam TTrans
+ *  \tparam TStateCont
+ */
+template<typename TTrans, template<typename> class TStateCont = std::vector>
+class reverse_fsm
+{
+    using fsm_type = fsm<TTrans, TStateCont>;
+    using reverse_fsm_type = reverse_fsm<TTrans, TStateCont>;
+
+public:
+    using event_type = typename fsm_type::event_type;
+    using ptr = std::shared_ptr<reverse_fsm_type>;
+    using state_id = typename fsm_type::state_id;
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    reverse_fsm() = default;
+
+    explicit reverse_fsm(const size_t reserve_size)
+        : m_fsm(reserve_size)
+    {}
+
+    template<typename TIt>
+    bool any_suffix(const TIt first, const TIt last) const { return longest(first, last, nullptr, true) != npos; }
+
+    template<typename TIt>
+    bool any_suffix(const TIt first, const TIt last, const event_type& boundary) const
+    {
+        return longest(first, last, &boundary, true) != npos;
+    }
+
+    template<template<typename> class TCont>
+    bool any_suffix(const TCont<event_type>& cnt) const { return any_suffix(std::cbegin(cnt), std::cend(cnt)); }
+
+    template<template<typename> class TCont>
+    bool any_suffix(const TCont<event_type>& cnt, const event_type& boundary) const
+    {
+        return any_suffix(std::cbegin(cnt), std::cend(cnt), boundary);
+    }
+
+    void clear() { m_fsm = fsm_type(); }
+
+    /**
+     *  \brief Returns true if the whole input is the inserted key.
+     */
+    template<typename TIt>
+    bool follow(const TIt first, TIt last) const
+    {
+        state_id st = m_fsm.begin();
+        while (last != first) {
+            const event_type& ev = *(--last);
+            if (! m_fsm.is_valid_event(ev)) {
+                return false;
+            }
+            st = m_fsm.follow(st, ev);
+            if (st == m_fsm.invalid()) {
+                return false;
+            }
+        }
+        return m_fsm.is_available(st);
+    }
+
+    template<template<typename> class TCont>
+    bool follow(const TCont<event_type>& cnt) const { return follow(std::cbegin(cnt), std::cend(cnt)); }
+
+    template<typename TIt>
+    bool insert(const TIt first, const TIt last)
+    {
+        const std::vector<event_type> key(std::make_reverse_iterator(last), std::make_reverse_iterator(first));
+        return m_fsm.insert(key);
+    }
+
+    template<template<typename> class TCont>
+    bool insert(const TCont<event_type>& cnt) { return insert(std::cbegin(cnt), std::cend(cnt)); }
+
+    /**
+     *  \brief Returns the length of the longest inserted key that is the suffix of the input or
+     *         'npos' if there is no one.
+     */
+    template<typename TIt>
+    size_t longest_suffix(const TIt first, const TIt last) const { return longest(first, last, nullptr, false); }
+
+    template<typename TIt>
+    size_t longest_suffix(const TIt first, const TIt last, const event_type& boundary) const
+    {
+        return longest(first, last, &boundary, false);
+    }
+
+    template<template<typename> class TCont>
+    size_t longest_suffix(const TCont<event_type>& cnt) const
+    {
+        return longest_suffix(std::cbegin(cnt), std::cend(cnt));
+    }
+
+    template<template<typename> class TCont>
+    size_t longest_suffix(const TCont<event_type>& cnt, const event_type& boundary) const
+    {
+        return longest_suffix(std::cbegin(cnt), std::cend(cnt), boundary);
+    }
+
+    void reserve(const size_t size) { m_fsm.reserve(size); }
+
+    size_t size() const { return m_fsm.size(); }
+
+    void swap(reverse_fsm& other) { m_fsm.swap(other.m_fsm); }
+
+private:
+    template<typename TIt>
+    size_t longest(const TIt first, TIt it, const event_type* p_boundary, const bool is_any) const
+    {
+        // The suffix starting at 'it' is matched if it is the whole input or follows the boundary.
+        const auto is_matched = [first, p_boundary](const TIt& it) {
+                return (p_boundary == nullptr) || (it == first) || (*std::prev(it) == *p_boundary);
+            };
+
+        size_t res = npos;
+        size_t len = 0;
+        state_id st = m_fsm.begin();
+        while (true) {
+            if (m_fsm.is_available(st) && is_matched(it)) {
+                res = len;
+                if (is_any) {
+                    break;
+                }
+            }
+            if (it == first) {
+                break;
+            }
+            const event_type& ev = *(--it);
+            if (! m_fsm.is_valid_event(ev)) {
+                break;
+            }
+            st = m_fsm.follow(st, ev);
+            if (st == m_fsm.invalid()) {
+                break;
+            }
+            ++len;
+        }
+        return res;
+    }
+
+private:
+    fsm_type m_fsm;
+};
+
+} // namespace fsm
+
+#endif // FSM_REVERSE_H
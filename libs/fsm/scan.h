@@ -0,0 +1,275 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_SCAN_H
+#define FSM_SCAN_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fsm {
+namespace details {
+
+/**
+ *  \brief  Runs tasks on the threads started once for the lifetime of the pool. Every thread
+ *          takes tasks from the front of its own queue and steals from the back of other queues
+ *          when its queue is empty. The destructor waits for all submitted tasks.
+ */
+template<typename TTask>
+class work_stealing_pool final
+{
+    struct queue_t final
+    {
+        std::mutex mutex;
+        std::deque<TTask> tasks;
+    };
+
+public:
+    explicit work_stealing_pool(const size_t threads)
+        : m_queues(std::max<size_t>(threads, 1))
+    {
+        for (size_t i = 0; i < m_queues.size(); ++i) {
+            m_threads.emplace_back([this, i]() { work(i); });
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_stopped = true;
+        }
+        m_cv.notify_all();
+        for (std::thread& th : m_threads) {
+            th.join();
+        }
+    }
+
+    /**
+     *  \brief Queues the task to the threads in turn.
+     */
+    void submit(TTask task)
+    {
+        queue_t& queue = m_queues[m_next++ % m_queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.emplace_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_pending;
+        }
+        m_cv.notify_one();
+    }
+
+private:
+    bool pop(const size_t idx, TTask& task)
+    {
+        queue_t& queue = m_queues[idx];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(const size_t idx, TTask& task)
+    {
+        for (size_t i = 1; i < m_queues.size(); ++i) {
+            queue_t& queue = m_queues[(idx + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (! queue.tasks.empty()) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(const size_t idx)
+    {
+        TTask task;
+        while (true) {
+            if (pop(idx, task) || steal(idx, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    --m_pending;
+                }
+                task();
+                continue;
+            }
+
+            // A task counted as pending may be taken by other thread yet, so the queues are
+            // checked again after the wake up.
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() { return m_is_stopped || (m_pending > 0); });
+            if (m_is_stopped && (m_pending == 0)) {
+                return;
+            }
+        }
+    }
+
+private:
+    std::deque<queue_t> m_queues;
+    std::vector<std::thread> m_threads;
+    size_t m_next = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_pending = 0;
+    bool m_is_stopped = false;
+};
+
+} // namespace details
+
+/**
+ *  \brief Calls fn(pos, len, st) for every occurrence of an accepted key in the data, where 'st'
+ *         is the accepting state of the key. Occurrences are reported in order of 'pos', then
+ *         of 'len'. Only occurrences starting in [first, last) are reported, but they may end
+ *         anywhere in the data.
+ *  \details  The automaton is walked from every position, so it is intended for dictionaries
+ *            (acyclic automata) where the walk is bounded by the maximal key length. The data
+ *            may contain any bytes: events out of the alphabet (see 'is_valid_event') are not
+ *            followed and stop the walk like a missing transition.
+ */
+template<typename TFsm, typename TFn>
+void scan(const TFsm& fsm, const typename TFsm::event_type* p_data, const size_t size, const size_t first,
+          const size_t last, TFn&& fn)
+{
+    for (size_t pos = first; pos < last; ++pos) {
+        typename TFsm::state_id st = fsm.begin();
+        for (size_t i = pos; i < size; ++i) {
+            if (! fsm.is_valid_event(p_data[i])) {
+                break;
+            }
+            st = fsm.follow(st, p_data[i]);
+            if (st == fsm.invalid()) {
+                break;
+            }
+            if (fsm.is_available(st)) {
+                fn(pos, i + 1 - pos, st);
+            }
+        }
+    }
+}
+
+template<typename TFsm, typename TFn>
+void scan(const TFsm& fsm, const typename TFsm::event_type* p_data, const size_t size, TFn&& fn)
+{
+    scan(fsm, p_data, size, 0, size, fn);
+}
+
+/**
+ *  \brief Multi-threaded version of 'scan'. The data is split to chunks of start positions, a
+ *         match crossing the chunk boundary belongs to the chunk where it starts. The chunks are
+ *         processed by the work-stealing pool and 'fn' is called from the calling thread in the
+ *         same order as by 'scan'.
+ *  \details  At most 'chunks_per_thread' chunks per thread are in flight: the matches of a chunk
+ *            are buffered until all previous chunks are passed to 'fn', then the next chunk takes
+ *            its buffer. So the memory is bounded by the matches of the chunks in flight, not of
+ *            the whole data, and the threads are not stopped to wait for the slowest chunk.
+ */
+template<typename TFsm, typename TFn>
+void parallel_scan(const TFsm& fsm, const typename TFsm::event_type* p_data, const size_t size,
+                   const size_t threads, TFn&& fn, const size_t chunk_size = 1 << 20,
+                   const size_t chunks_per_thread = 4)
+{
+    struct match_t final
+    {
+        size_t pos;
+        size_t len;
+        typename TFsm::state_id st;
+    };
+
+    struct slot_t final
+    {
+        std::vector<match_t> matches;
+        bool is_ready = false;
+    };
+
+    if ((threads <= 1) || (size <= chunk_size)) {
+        scan(fsm, p_data, size, fn);
+        return;
+    }
+
+    const size_t step = std::max<size_t>(chunk_size, 1);
+    const size_t chunks_count = (size + step - 1) / step;
+    const size_t window = std::min(chunks_count, threads * std::max<size_t>(chunks_per_thread, 1));
+
+    // The slots outlive the pool, which waits for its tasks in the destructor.
+    std::vector<slot_t> slots(window);
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    using task_type = std::function<void()>;
+    details::work_stealing_pool<task_type> pool(threads);
+    const auto submit = [&](const size_t chunk) {
+            pool.submit([&fsm, p_data, size, step, chunk, &slot = slots[chunk % window], &mutex, &cv]() {
+                            const size_t first = chunk * step;
+                            const size_t last = std::min(size, first + step);
+                            scan(fsm, p_data, size, first, last,
+                                 [&slot](const size_t pos, const size_t len, const typename TFsm::state_id& st) {
+                                     slot.matches.push_back(match_t{pos, len, st});
+                                 });
+                            {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                slot.is_ready = true;
+                            }
+                            cv.notify_one();
+                        });
+        };
+
+    for (size_t chunk = 0; chunk < window; ++chunk) {
+        submit(chunk);
+    }
+    for (size_t chunk = 0; chunk < chunks_count; ++chunk) {
+        slot_t& slot = slots[chunk % window];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&slot]() { return slot.is_ready; });
+            slot.is_ready = false;
+        }
+        for (const match_t& m : slot.matches) {
+            fn(m.pos, m.len, m.st);
+        }
+        slot.matches.clear();
+        if (chunk + window < chunks_count) {
+            submit(chunk + window);
+        }
+    }
+}
+
+} // namespace fsm
+
+#endif // FSM_SCAN_H
@@ -0,0 +1,195 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_SET_OPS_H
+#define FSM_SET_OPS_H
+
+#include <cassert>
+#include <cstdint>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "fsm/fsm.h"
+#include "fsm/trie.h"
+
+namespace fsm {
+
+/**
+ *  \brief Bit 'i' of the mask is set if the operand 'i' accepts the key.
+ */
+using operand_mask = uint64_t;
+
+namespace details {
+
+enum class set_op
+{
+    union_of,
+    intersect,
+    difference
+};
+
+template<typename TState>
+bool _is_live(const std::vector<TState>& tuple, const set_op op)
+{
+    switch (op) {
+    case set_op::union_of:
+        return std::any_of(tuple.cbegin(), tuple.cend(), [](const TState& st) { return st != 0; });
+    case set_op::intersect:
+        return std::all_of(tuple.cbegin(), tuple.cend(), [](const TState& st) { return st != 0; });
+    case set_op::difference:
+        return (tuple.front() != 0);
+    }
+    return false;
+}
+
+inline bool _is_accepted(const operand_mask mask, const size_t count, const set_op op)
+{
+    const operand_mask all = (count < 64) ? (((operand_mask)1 << count) - 1) : ~(operand_mask)0;
+    switch (op) {
+    case set_op::union_of:   return (mask != 0);
+    case set_op::intersect:  return (mask == all);
+    case set_op::difference: return (mask == 1);
+    }
+    return false;
+}
+
+/**
+ *  \brief Builds the product automaton of the operands. Only reachable tuples of states that can
+ *         still be accepted by the operation are created.
+ */
+template<typename TRes, typename TFsm>
+TRes _product(const std::vector<const TFsm*>& operands, const set_op op)
+{
+    using state_id = typename TFsm::state_id;
+    using event_type = typename TFsm::event_type;
+    using tuple_type = std::vector<state_id>;
+
+    assert(! operands.empty() && (operands.size() <= 64) && "fsm::_product(): invalid operands count");
+
+    TRes res;
+    std::map<tuple_type, state_id> ids;
+    std::vector<tuple_type> tuples;
+
+    tuple_type tuple;
+    for (const TFsm* p_fsm : operands) {
+        tuple.emplace_back(p_fsm->begin());
+    }
+    ids.emplace(tuple, res.begin());
+    tuples.emplace_back(tuple);
+
+    std::vector<event_type> events;
+    for (size_t i = 0; i < tuples.size(); ++i) {
+        const tuple_type cur = tuples[i];
+        const state_id from = ids[cur];
+
+        operand_mask mask = 0;
+        events.clear();
+        for (size_t j = 0; j < operands.size(); ++j) {
+            if (cur[j] == operands[j]->invalid()) {
+                continue;
+            }
+            if (operands[j]->is_available(cur[j])) {
+                mask |= (operand_mask)1 << j;
+            }
+            operands[j]->for_each_trans(cur[j], [&events](const event_type& ev, const state_id&) {
+                                                    events.emplace_back(ev);
+                                                });
+        }
+        if (_is_accepted(mask, operands.size(), op)) {
+            res.make_available(from);
+            res.set_value(from, mask);
+        }
+
+        std::sort(events.begin(), events.end());
+        events.erase(std::unique(events.begin(), events.end()), events.end());
+        for (const event_type& ev : events) {
+            for (size_t j = 0; j < operands.size(); ++j) {
+                tuple[j] = (cur[j] != operands[j]->invalid()) ? operands[j]->follow(cur[j], ev) : cur[j];
+            }
+            if (! _is_live(tuple, op)) {
+                continue;
+            }
+
+            typename std::map<tuple_type, state_id>::const_iterator it = ids.find(tuple);
+            if (it == ids.cend()) {
+                it = ids.emplace(tuple, res.make_state_id()).first;
+                tuples.emplace_back(tuple);
+            }
+            res.link(from, ev, it->second);
+        }
+    }
+    return res;
+}
+
+} // namespace details
+
+/**
+ *  \brief Accepts keys accepted by any operand. The value is the mask of operands that accept
+ *         the key, so one walk answers all operands at once.
+ */
+template<typename TTrans, template<typename> class TStateCont, typename TStats>
+trie<operand_mask, TTrans, TStateCont> union_of(const std::vector<const fsm<TTrans, TStateCont, TStats>*>& operands)
+{
+    return details::_product<trie<operand_mask, TTrans, TStateCont>>(operands, details::set_op::union_of);
+}
+
+template<typename TTrans, template<typename> class TStateCont, typename TStats>
+trie<operand_mask, TTrans, TStateCont> union_of(const fsm<TTrans, TStateCont, TStats>& lhs,
+                                                const fsm<TTrans, TStateCont, TStats>& rhs)
+{
+    return union_of(std::vector<const fsm<TTrans, TStateCont, TStats>*>{&lhs, &rhs});
+}
+
+/**
+ *  \brief Accepts keys accepted by all operands.
+ */
+template<typename TTrans, template<typename> class TStateCont, typename TStats>
+trie<operand_mask, TTrans, TStateCont> intersect(const std::vector<const fsm<TTrans, TStateCont, TStats>*>& operands)
+{
+    return details::_product<trie<operand_mask, TTrans, TStateCont>>(operands, details::set_op::intersect);
+}
+
+template<typename TTrans, template<typename> class TStateCont, typename TStats>
+trie<operand_mask, TTrans, TStateCont> intersect(const fsm<TTrans, TStateCont, TStats>& lhs,
+                                                 const fsm<TTrans, TStateCont, TStats>& rhs)
+{
+    return intersect(std::vector<const fsm<TTrans, TStateCont, TStats>*>{&lhs, &rhs});
+}
+
+/**
+ *  \brief Accepts keys accepted by 'lhs' and not accepted by 'rhs'.
+ */
+template<typename TTrans, template<typename> class TStateCont, typename TStats>
+trie<operand_mask, TTrans, TStateCont> difference(const fsm<TTrans, TStateCont, TStats>& lhs,
+                                                  const fsm<TTrans, TStateCont, TStats>& rhs)
+{
+    const std::vector<const fsm<TTrans, TStateCont, TStats>*> operands = {&lhs, &rhs};
+    return details::_product<trie<operand_mask, TTrans, TStateCont>>(operands, details::set_op::difference);
+}
+
+} // namespace fsm
+
+#endif // FSM_SET_OPS_H
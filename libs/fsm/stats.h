@@ -0,0 +1,211 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_STATS_H
+#define FSM_STATS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace fsm {
+
+enum class lookup_result
+{
+    accepted,       // the key was walked to the available state
+    rejected,       // there was no transition for one of the events
+    not_available   // the key was walked to the state that is not available
+};
+
+/**
+ *  \brief  Default statistics policy. All hooks are empty and compile to nothing.
+ */
+struct null_stats final
+{
+    static void on_lookup(const size_t /*depth*/, const lookup_result /*res*/) {}
+};
+
+/**
+ *  \brief  Statistics policy that counts lookups, transitions and depth reached.
+ *  \details  Every thread updates its own counters, so the hot loop does not share cache lines
+ *            with other threads. The counters of all threads are aggregated on 'snapshot'.
+ *            Counters of finished threads are kept until 'reset'.
+ */
+class counting_stats final
+{
+public:
+    static constexpr size_t depth_buckets = 64;
+
+    struct counters final
+    {
+        void merge(const counters& other)
+        {
+            lookups += other.lookups;
+            transitions += other.transitions;
+            accepted += other.accepted;
+            rejected += other.rejected;
+            not_available += other.not_available;
+            for (size_t i = 0; i < depth_buckets; ++i) {
+                depth[i] += other.depth[i];
+            }
+        }
+
+        uint64_t lookups = 0;
+        uint64_t transitions = 0;
+        uint64_t accepted = 0;
+        uint64_t rejected = 0;
+        uint64_t not_available = 0;
+        // The last bucket counts all lookups with the depth greater or equal to 'depth_buckets - 1'.
+        std::array<uint64_t, depth_buckets> depth = {};
+    };
+
+    static void on_lookup(const size_t depth, const lookup_result res)
+    {
+        local_counters& c = local();
+        increment(c.lookups);
+        add(c.transitions, depth);
+        switch (res) {
+        case lookup_result::accepted:      increment(c.accepted);      break;
+        case lookup_result::rejected:      increment(c.rejected);      break;
+        case lookup_result::not_available: increment(c.not_available); break;
+        }
+        increment(c.depth[(depth < depth_buckets) ? depth : (depth_buckets - 1)]);
+    }
+
+    static void reset()
+    {
+        registry& reg = get_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.retired = counters();
+        for (local_counters* p_local : reg.locals) {
+            p_local->reset();
+        }
+    }
+
+    static counters snapshot()
+    {
+        registry& reg = get_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        counters res = reg.retired;
+        for (const local_counters* p_local : reg.locals) {
+            res.merge(p_local->load());
+        }
+        return res;
+    }
+
+private:
+    using counter = std::atomic<uint64_t>;
+
+    struct local_counters;
+
+    struct registry final
+    {
+        std::mutex mutex;
+        std::vector<local_counters*> locals;
+        counters retired;
+    };
+
+    struct local_counters final
+    {
+        local_counters()
+        {
+            registry& reg = get_registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            reg.locals.emplace_back(this);
+        }
+
+        ~local_counters()
+        {
+            registry& reg = get_registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            reg.retired.merge(load());
+            for (size_t i = 0; i < reg.locals.size(); ++i) {
+                if (reg.locals[i] == this) {
+                    reg.locals[i] = reg.locals.back();
+                    reg.locals.pop_back();
+                    break;
+                }
+            }
+        }
+
+        counters load() const
+        {
+            counters res;
+            res.lookups = lookups.load(std::memory_order_relaxed);
+            res.transitions = transitions.load(std::memory_order_relaxed);
+            res.accepted = accepted.load(std::memory_order_relaxed);
+            res.rejected = rejected.load(std::memory_order_relaxed);
+            res.not_available = not_available.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < depth_buckets; ++i) {
+                res.depth[i] = depth[i].load(std::memory_order_relaxed);
+            }
+            return res;
+        }
+
+        void reset()
+        {
+            lookups.store(0, std::memory_order_relaxed);
+            transitions.store(0, std::memory_order_relaxed);
+            accepted.store(0, std::memory_order_relaxed);
+            rejected.store(0, std::memory_order_relaxed);
+            not_available.store(0, std::memory_order_relaxed);
+            for (counter& c : depth) {
+                c.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        counter lookups = {0};
+        counter transitions = {0};
+        counter accepted = {0};
+        counter rejected = {0};
+        counter not_available = {0};
+        std::array<counter, depth_buckets> depth = {};
+    };
+
+    // Counters have the single writer, so there is no need for the atomic read-modify-write.
+    static void add(counter& c, const uint64_t val)
+    {
+        c.store(c.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+    }
+
+    static void increment(counter& c) { add(c, 1); }
+
+    static registry& get_registry()
+    {
+        static registry reg;
+        return reg;
+    }
+
+    static local_counters& local()
+    {
+        thread_local local_counters c;
+        return c;
+    }
+};
+
+} // namespace fsm
+
+#endif // FSM_STATS_H
@@ -33,11 +33,11 @@
 namespace fsm {
 
 template<typename TValue, typename TTrans, template<typename> class TStateCont = std::vector,
-         typename TValueCont = std::map<typename TTrans::state_type, TValue>>
+         typename TValueCont = std::map<typename TTrans::state_type, TValue>, typename TStats = null_stats>
 class trie
 {
-    using fsm_type = fsm<TTrans, TStateCont>;
-    using trie_type = trie<TValue, TTrans, TStateCont, TValueCont>;
+    using fsm_type = fsm<TTrans, TStateCont, TStats>;
+    using trie_type = trie<TValue, TTrans, TStateCont, TValueCont, TStats>;
     using value_list = TValueCont;
 
 public:
@@ -87,8 +87,16 @@ public:
 
     const state_id& begin() const { return m_fsm.begin(); }
 
+    size_t capacity() const { return m_fsm.capacity(); }
+
     void clear() { m_fsm.clear(); }
 
+    template<template<typename> class TCont>
+    void count_visits(const TCont<event_type>& cnt, std::vector<size_t>& visits) const
+    {
+        m_fsm.count_visits(cnt, visits);
+    }
+
     state_id follow(state_id& st, const event_type& ev) const { return m_fsm.follow(st, ev); }
 
     bool follow(state_id& st, const event_type& ev, value_type& val) const
@@ -108,22 +116,37 @@ public:
     bool follow(const TCont<event_type>& cnt, value_type& val) const
     {
         state_id st = begin();
+        size_t depth = 0;
         for (const event_type& ev : cnt) {
             st = follow(st, ev);
             if (st == invalid()) {
+                TStats::on_lookup(depth, lookup_result::rejected);
                 return false;
             }
+            ++depth;
         }
         if (is_available(st)) {
+            TStats::on_lookup(depth, lookup_result::accepted);
             val = value(st);
             return true;
         }
+        TStats::on_lookup(depth, lookup_result::not_available);
         return false;
     }
 
+    template<typename TFn>
+    void for_each_trans(const state_id& st, TFn fn) const { m_fsm.for_each_trans(st, fn); }
+
     template<template<typename> class TCont>
     bool insert(const TCont<event_type>& cnt, const value_type& val)
     {
+        // Events are checked before any change as in 'fsm::insert'.
+        for (const event_type& ev : cnt) {
+            if (! is_valid_event(ev)) {
+                return false;
+            }
+        }
+
         state_id st = begin();
         for (size_t i = 0; i < cnt.size(); ++i) {
             const event_type& ev = cnt[i];
@@ -147,7 +170,35 @@ public:
 
     bool is_available(const state_id& st) const { return m_fsm.is_available(st); }
 
-    void reserve(const size_t size) const { m_fsm.reserve(size); }
+    bool is_valid_event(const event_type& ev) const { return m_fsm.is_valid_event(ev); }
+
+    bool link(const state_id& from, const event_type& ev, const state_id& to) { return m_fsm.link(from, ev, to); }
+
+    void make_available(const state_id& st) { m_fsm.make_available(st); }
+
+    state_id make_state_id() { return m_fsm.make_state_id(); }
+
+    void prefetch(const state_id& st, const event_type& ev) const { m_fsm.prefetch(st, ev); }
+
+    /**
+     *  \brief Renumbers states for the cache locality of lookups (see 'fsm::relayout').
+     */
+    std::vector<state_id> relayout(const std::vector<size_t>& visits = std::vector<size_t>(),
+                                   const size_t bfs_depth = 2)
+    {
+        const std::vector<state_id> map = m_fsm.relayout(visits, bfs_depth);
+
+        value_list values;
+        for (typename value_list::iterator it = m_values.begin(); it != m_values.end(); ++it) {
+            if (map[it->first] != invalid()) {
+                values.emplace(map[it->first], std::move(it->second));
+            }
+        }
+        std::swap(m_values, values);
+        return map;
+    }
+
+    void reserve(const size_t size) { m_fsm.reserve(size); }
 
     void set_value(const state_id& st, const value_type& val) { m_values[st] = val; }
 
@@ -162,6 +213,22 @@ public:
         std::swap(m_values, other.m_values);
     }
 
+    /**
+     *  \brief Inserts the key without the reallocation of states (see 'fsm::try_insert').
+     *  \details  The value of the existing key is not changed. The value is stored in 'TValueCont',
+     *            so the insert is allocation-free only if the value container does not allocate.
+     */
+    template<template<typename> class TCont>
+    insert_status try_insert(const TCont<event_type>& cnt, const value_type& val)
+    {
+        state_id st = invalid();
+        const insert_status res = m_fsm.try_insert(cnt, st);
+        if (res == insert_status::ok) {
+            m_values[st] = val;
+        }
+        return res;
+    }
+
     const value_type& value(const state_id& st) const { return m_values.at(st); }
 
 private:
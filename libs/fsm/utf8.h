@@ -0,0 +1,334 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2022 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FSM_UTF8_H
+#define FSM_UTF8_H
+
+#include <array>
+#include <string>
+#include <string_view>
+
+#include "fsm/fsm.h"
+
+namespace fsm {
+namespace utf8 {
+
+/**
+ *  \brief Flat byte-level transitions for the UTF-8 mode.
+ */
+template<typename TSt>
+using byte_traits = trans_traits<unsigned char, TSt, std::array<TSt, 256>, true>;
+
+constexpr size_t max_variants = 3;
+
+inline bool is_valid(const char32_t cp) { return (cp <= 0x10FFFF) && ((cp < 0xD800) || (cp > 0xDFFF)); }
+
+/**
+ *  \brief Writes the UTF-8 encoding of the code point to 'p_buf' (4 bytes at least).
+ *  \return The length of the encoding or 0 if the code point is invalid.
+ */
+inline size_t encode(const char32_t cp, unsigned char* p_buf)
+{
+    if (! is_valid(cp)) {
+        return 0;
+    }
+    if (cp < 0x80) {
+        p_buf[0] = (unsigned char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        p_buf[0] = (unsigned char)(0xC0 | (cp >> 6));
+        p_buf[1] = (unsigned char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        p_buf[0] = (unsigned char)(0xE0 | (cp >> 12));
+        p_buf[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        p_buf[2] = (unsigned char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    p_buf[0] = (unsigned char)(0xF0 | (cp >> 18));
+    p_buf[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+    p_buf[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+    p_buf[3] = (unsigned char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/**
+ *  \brief Decodes the UTF-8 string. Overlong encodings, surrogates and truncated sequences are
+ *         rejected.
+ */
+inline bool decode(const std::string_view& str, std::u32string& res)
+{
+    res.clear();
+    for (size_t i = 0; i < str.size();) {
+        const unsigned char lead = (unsigned char)str[i];
+        size_t len = 0;
+        char32_t cp = 0;
+        if (lead < 0x80) {
+            len = 1;
+            cp = lead;
+        } else if ((lead & 0xE0) == 0xC0) {
+            len = 2;
+            cp = lead & 0x1F;
+        } else if ((lead & 0xF0) == 0xE0) {
+            len = 3;
+            cp = lead & 0x0F;
+        } else if ((lead & 0xF8) == 0xF0) {
+            len = 4;
+            cp = lead & 0x07;
+        } else {
+            return false;
+        }
+        if (i + len > str.size()) {
+            return false;
+        }
+        for (size_t j = 1; j < len; ++j) {
+            const unsigned char ch = (unsigned char)str[i + j];
+            if ((ch & 0xC0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (ch & 0x3F);
+        }
+        static constexpr char32_t min_cp[] = {0, 0, 0x80, 0x800, 0x10000};
+        if ((cp < min_cp[len]) || ! is_valid(cp)) {
+            return false;
+        }
+        res.push_back(cp);
+        i += len;
+    }
+    return true;
+}
+
+/**
+ *  \brief Simple case folding for Latin, Greek and Cyrillic scripts.
+ */
+inline char32_t to_lower(const char32_t cp)
+{
+    if (((cp >= 'A') && (cp <= 'Z')) || ((cp >= 0xC0) && (cp <= 0xDE) && (cp != 0xD7))) {
+        return cp + 0x20;
+    }
+    if (cp == 0x178) {
+        return 0xFF;
+    }
+    if (((cp >= 0x100) && (cp <= 0x12F)) || ((cp >= 0x132) && (cp <= 0x137)) || ((cp >= 0x14A) && (cp <= 0x177))) {
+        return cp | 1;
+    }
+    if (((cp >= 0x139) && (cp <= 0x148)) || ((cp >= 0x179) && (cp <= 0x17E))) {
+        return ((cp & 1) != 0) ? cp + 1 : cp;
+    }
+    if (((cp >= 0x391) && (cp <= 0x3A9) && (cp != 0x3A2)) || ((cp >= 0x410) && (cp <= 0x42F))) {
+        return cp + 0x20;
+    }
+    if (cp == 0x3C2) {
+        return 0x3C3; // final sigma
+    }
+    if (cp == 0x386) {
+        return 0x3AC;
+    }
+    if ((cp >= 0x388) && (cp <= 0x38A)) {
+        return cp + 0x25;
+    }
+    if (cp == 0x38C) {
+        return 0x3CC;
+    }
+    if ((cp == 0x38E) || (cp == 0x38F)) {
+        return cp + 0x3F;
+    }
+    if ((cp >= 0x400) && (cp <= 0x40F)) {
+        return cp + 0x50;
+    }
+    return cp;
+}
+
+inline char32_t to_upper(const char32_t cp)
+{
+    if (((cp >= 'a') && (cp <= 'z')) || ((cp >= 0xE0) && (cp <= 0xFE) && (cp != 0xF7))) {
+        return cp - 0x20;
+    }
+    if (cp == 0xFF) {
+        return 0x178;
+    }
+    if (((cp >= 0x100) && (cp <= 0x12F)) || ((cp >= 0x132) && (cp <= 0x137)) || ((cp >= 0x14A) && (cp <= 0x177))) {
+        return cp & ~(char32_t)1;
+    }
+    if (((cp >= 0x139) && (cp <= 0x148)) || ((cp >= 0x179) && (cp <= 0x17E))) {
+        return ((cp & 1) == 0) ? cp - 1 : cp;
+    }
+    if (((cp >= 0x3B1) && (cp <= 0x3C9) && (cp != 0x3C2)) || ((cp >= 0x430) && (cp <= 0x44F))) {
+        return cp - 0x20;
+    }
+    if (cp == 0x3C2) {
+        return 0x3A3; // final sigma
+    }
+    if (cp == 0x3AC) {
+        return 0x386;
+    }
+    if ((cp >= 0x3AD) && (cp <= 0x3AF)) {
+        return cp - 0x25;
+    }
+    if (cp == 0x3CC) {
+        return 0x38C;
+    }
+    if ((cp == 0x3CD) || (cp == 0x3CE)) {
+        return cp - 0x3F;
+    }
+    if ((cp >= 0x450) && (cp <= 0x45F)) {
+        return cp - 0x50;
+    }
+    return cp;
+}
+
+/**
+ *  \brief Writes all code points of the case folding class of 'cp' to 'p_vars', the folded
+ *         (lower case) code point goes first.
+ *  \return The number of variants, not greater than 'max_variants'.
+ */
+inline size_t case_variants(const char32_t cp, char32_t* p_vars)
+{
+    size_t count = 0;
+    p_vars[count++] = to_lower(cp);
+    const char32_t upper = to_upper(p_vars[0]);
+    if (upper != p_vars[0]) {
+        p_vars[count++] = upper;
+    }
+    if (p_vars[0] == 0x3C3) {
+        p_vars[count++] = 0x3C2; // final sigma
+    }
+    return count;
+}
+
+/**
+ *  \brief Adds byte-level transitions for the code point from the state 'from'.
+ *  \details  If 'case_fold' is set, all case variants of the code point lead to the same state.
+ *            The automaton must be filled with the same 'case_fold' value for every key.
+ *  \return The state after the code point or 'invalid()' if the code point is invalid or its
+ *          transitions conflict with existing ones.
+ */
+template<typename TFsm>
+typename TFsm::state_id insert(TFsm& fsm, const typename TFsm::state_id& from, const char32_t cp,
+                               const bool case_fold)
+{
+    char32_t vars[max_variants] = {cp};
+    const size_t vars_count = case_fold ? case_variants(cp, vars) : 1;
+
+    unsigned char buf[4];
+    size_t len = encode(vars[0], buf);
+    if (len == 0) {
+        return fsm.invalid();
+    }
+
+    // All variants of the code point are inserted together, so the folded one is enough to check.
+    typename TFsm::state_id st = from;
+    for (size_t i = 0; (i < len) && (st != fsm.invalid()); ++i) {
+        st = fsm.follow(st, buf[i]);
+    }
+    if (st != fsm.invalid()) {
+        return st;
+    }
+
+    const typename TFsm::state_id to = fsm.make_state_id();
+    for (size_t v = 0; v < vars_count; ++v) {
+        len = encode(vars[v], buf);
+        st = from;
+        for (size_t i = 0; i + 1 < len; ++i) {
+            typename TFsm::state_id st_to = fsm.follow(st, buf[i]);
+            if (st_to == fsm.invalid()) {
+                st_to = fsm.insert(st, buf[i], false);
+                if (st_to == fsm.invalid()) {
+                    return fsm.invalid();
+                }
+            }
+            st = st_to;
+        }
+        if (! fsm.link(st, buf[len - 1], to)) {
+            return fsm.invalid();
+        }
+    }
+    return to;
+}
+
+/**
+ *  \brief Inserts the key of code points and makes the final state available.
+ *  \return The final state of the key or 'invalid()' if the key contains invalid code points.
+ */
+template<typename TFsm>
+typename TFsm::state_id insert(TFsm& fsm, const std::u32string& key, const bool case_fold = false)
+{
+    for (const char32_t cp : key) {
+        if (! is_valid(cp)) {
+            return fsm.invalid();
+        }
+    }
+
+    typename TFsm::state_id st = fsm.begin();
+    for (const char32_t cp : key) {
+        st = insert(fsm, st, cp, case_fold);
+        if (st == fsm.invalid()) {
+            return fsm.invalid();
+        }
+    }
+    fsm.make_available(st);
+    return st;
+}
+
+template<typename TFsm>
+typename TFsm::state_id insert(TFsm& fsm, const std::string_view& key, const bool case_fold = false)
+{
+    std::u32string cps;
+    if (! decode(key, cps)) {
+        return fsm.invalid();
+    }
+    return insert(fsm, cps, case_fold);
+}
+
+/**
+ *  \brief Walks raw UTF-8 bytes of the string.
+ *  \return The final state or 'invalid()'. Invalid UTF-8 sequences never match, because only
+ *          valid encodings are inserted to the automaton.
+ */
+template<typename TFsm>
+typename TFsm::state_id walk(const TFsm& fsm, const std::string_view& str)
+{
+    typename TFsm::state_id st = fsm.begin();
+    for (const char ch : str) {
+        st = fsm.follow(st, (unsigned char)ch);
+        if (st == fsm.invalid()) {
+            return st;
+        }
+    }
+    return st;
+}
+
+template<typename TFsm>
+bool follow(const TFsm& fsm, const std::string_view& str)
+{
+    const typename TFsm::state_id st = walk(fsm, str);
+    return (st != fsm.invalid()) && fsm.is_available(st);
+}
+
+} // namespace utf8
+} // namespace fsm
+
+#endif // FSM_UTF8_H
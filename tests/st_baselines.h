@@ -0,0 +1,67 @@
+#ifndef TESTING_ST_BASELINES_H
+#define TESTING_ST_BASELINES_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+
+#include "fsm/fsm.h"
+
+namespace tests {
+
+using str_trans_flat = fsm::trans_traits<char, uint32_t, std::array<uint32_t, 127>, true>;
+using str_trans_flex = fsm::trans_traits<char, uint32_t, std::map<char, uint32_t>, false>;
+
+/*
+ * Sanitizers change the time and memory by several times, so the bounds are not checked there.
+ */
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+constexpr bool is_sanitized = true;
+#elif defined(__has_feature)
+    #if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+constexpr bool is_sanitized = true;
+    #else
+constexpr bool is_sanitized = false;
+    #endif
+#else
+constexpr bool is_sanitized = false;
+#endif
+
+/*
+ * Upper bounds for the stress test 'st_fsm'. They are about 4 times the values measured on the
+ * reference host, so the test catches quadratic and memory regressions and not the noise. The
+ * memory depends only on the layout of states, so it has the same bound in all build types
+ * (measured 2.68 kB/key for flat and 0.44 kB/key for flex tables).
+ */
+template<typename TTrans>
+struct baseline;
+
+template<>
+struct baseline<str_trans_flat>
+{
+#if defined(NDEBUG)
+    static constexpr double max_build_ns_per_key = 13000;
+    static constexpr double max_lookup_ns = 8000;
+#else
+    static constexpr double max_build_ns_per_key = 22000;
+    static constexpr double max_lookup_ns = 13000;
+#endif
+    static constexpr double max_kb_per_key = 11.0;
+};
+
+template<>
+struct baseline<str_trans_flex>
+{
+#if defined(NDEBUG)
+    static constexpr double max_build_ns_per_key = 4500;
+    static constexpr double max_lookup_ns = 12000;
+#else
+    static constexpr double max_build_ns_per_key = 22000;
+    static constexpr double max_lookup_ns = 21000;
+#endif
+    static constexpr double max_kb_per_key = 1.8;
+};
+
+} // namespace tests
+
+#endif // TESTING_ST_BASELINES_H
@@ -0,0 +1,139 @@
+#include <sys/resource.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "fsm/fsm.h"
+#include "fsm/trie.h"
+
+#include "st_baselines.h"
+#include "testdefs.h"
+
+namespace {
+
+using tests::str_trans_flat;
+using tests::str_trans_flex;
+
+size_t env_or(const char* p_name, const size_t def)
+{
+    const char* p_val = std::getenv(p_name);
+    return (p_val != nullptr) ? std::strtoull(p_val, nullptr, 10) : def;
+}
+
+/*
+ * Resets the peak RSS of the process, returns false if the kernel does not support it.
+ */
+bool reset_peak_rss()
+{
+    std::ofstream file("/proc/self/clear_refs");
+    file << "5";
+    return file.good();
+}
+
+size_t peak_rss_kb()
+{
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+size_t current_rss_kb()
+{
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Keys look like URL paths, so they share prefixes on the top levels and diverge below.
+ */
+std::vector<std::string> make_keys(const size_t count)
+{
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const size_t h = (i * 2654435761u) % 1000003;
+        keys.emplace_back("/" + std::to_string(h % 97) + "/item/" + std::to_string(i));
+    }
+    return keys;
+}
+
+} // <anonymous> namespace
+
+INIT_TYPE_TESTS(fsm, str_trans_flat, str_trans_flex)
+
+TYPED_TEST(fsm, trie_scalability)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+    using baseline = tests::baseline<str_trans>;
+
+    const size_t keys_count = env_or("FSM_STRESS_KEYS", 100000);
+    const size_t lookups_count = env_or("FSM_STRESS_LOOKUPS", 200000);
+    const std::vector<std::string> keys = make_keys(keys_count);
+
+    const bool is_peak_reset = reset_peak_rss();
+    const size_t rss_before_kb = current_rss_kb();
+
+    tests::timer build_sw(true);
+    str_trie trie;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        EXPECTED(trie.insert(keys[i], i)) << keys[i] << std::endl;
+    }
+    const double build_ms = build_sw.value_ms();
+    const size_t peak_kb = peak_rss_kb();
+
+    size_t found = 0;
+    tests::timer lookup_sw(true);
+    for (size_t i = 0; i < lookups_count; ++i) {
+        size_t val = 0;
+        // Every 8th lookup misses on the last event.
+        const std::string& key = keys[(i * 7919) % keys.size()];
+        if ((i % 8) == 0) {
+            found += trie.follow(key + "x", val) ? 1 : 0;
+        } else if (trie.follow(key, val) && (val == (i * 7919) % keys.size())) {
+            ++found;
+        }
+    }
+    const double lookup_ms = lookup_sw.value_ms();
+    EXPECTED(found == lookups_count - (lookups_count + 7) / 8) << found << std::endl;
+
+    const double build_ns_per_key = build_ms * 1e6 / keys.size();
+    const double lookup_ns = lookup_ms * 1e6 / lookups_count;
+    const double kb_per_key = is_peak_reset ? (double)(peak_kb - rss_before_kb) / keys.size() : 0.0;
+
+    std::cout << "    keys: " << keys.size() << ", states: " << trie.size() << std::endl
+              << "    build: " << build_ms << " ms (" << build_ns_per_key << " ns/key)" << std::endl
+              << "    lookup: " << lookup_ms << " ms (" << lookup_ns << " ns/lookup, "
+              << (lookups_count / lookup_ms / 1000.0) << " Mlookups/s)" << std::endl
+              << "    peak rss: " << peak_kb << " kB (" << kb_per_key << " kB/key)" << std::endl;
+
+    if (tests::is_sanitized) {
+        return;
+    }
+    EXPECTED(build_ns_per_key <= baseline::max_build_ns_per_key)
+        << build_ns_per_key << " > " << baseline::max_build_ns_per_key << std::endl;
+    EXPECTED(lookup_ns <= baseline::max_lookup_ns)
+        << lookup_ns << " > " << baseline::max_lookup_ns << std::endl;
+    EXPECTED(kb_per_key <= baseline::max_kb_per_key)
+        << kb_per_key << " > " << baseline::max_kb_per_key << std::endl;
+}
+
+int main()
+{
+    return RUN_TESTS();
+}
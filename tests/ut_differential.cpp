@@ -0,0 +1,291 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include <array>
+#include <iterator>
+#include <map>
+#include <random>
+#include <regex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "fsm/compact_fsm.h"
+#include "fsm/fsm.h"
+#include "fsm/id_trie.h"
+#include "fsm/lazy_dfa.h"
+#include "fsm/louds.h"
+#include "fsm/pool.h"
+#include "fsm/regex.h"
+#include "fsm/trie.h"
+
+#include "testdefs.h"
+
+namespace {
+
+using str_trans_flat = fsm::trans_traits<char, uint32_t, std::array<uint32_t, 127>, true>;
+using str_trans_flex = fsm::trans_traits<char, uint32_t, std::map<char, uint32_t>, false>;
+
+using oracle_type = std::map<std::string, size_t>;
+
+constexpr size_t k_alphabet_size = 6;
+constexpr size_t k_max_key_size = 10;
+
+size_t env_or(const char* p_name, const size_t def)
+{
+    const char* p_val = std::getenv(p_name);
+    return (p_val != nullptr) ? std::strtoull(p_val, nullptr, 10) : def;
+}
+
+template<typename TFsm>
+void enumerate(const TFsm& fsm, const typename TFsm::state_id& st, std::string& prefix, std::set<std::string>& keys)
+{
+    if (fsm.is_available(st)) {
+        keys.emplace(prefix);
+    }
+    fsm.for_each_trans(st, [&fsm, &prefix, &keys](const char ev, const typename TFsm::state_id& to) {
+                               prefix.push_back(ev);
+                               enumerate(fsm, to, prefix, keys);
+                               prefix.pop_back();
+                           });
+}
+
+template<typename TFsm>
+void check_fsm(const std::string& name, const TFsm& fsm, const oracle_type& oracle,
+               const std::vector<std::string>& queries)
+{
+    for (const std::string& str : queries) {
+        EXPECTED(fsm.follow(str) == (oracle.count(str) != 0)) << name << ": '" << str << "'" << std::endl;
+    }
+
+    std::set<std::string> keys;
+    std::string prefix;
+    enumerate(fsm, fsm.begin(), prefix, keys);
+    EXPECTED(keys.size() == oracle.size()) << name << ": " << keys.size() << " != " << oracle.size() << std::endl;
+    for (const std::string& key : keys) {
+        EXPECTED(oracle.count(key) != 0) << name << ": '" << key << "'" << std::endl;
+    }
+}
+
+template<typename TTrie>
+void check_trie(const std::string& name, const TTrie& trie, const oracle_type& oracle,
+                const std::vector<std::string>& queries)
+{
+    check_fsm(name, trie, oracle, queries);
+    for (const std::string& str : queries) {
+        const oracle_type::const_iterator it = oracle.find(str);
+        size_t val = 0;
+        const bool res = trie.follow(str, val);
+        EXPECTED(res == (it != oracle.cend())) << name << ": '" << str << "'" << std::endl;
+        EXPECTED(! res || (val == it->second)) << name << ": '" << str << "' " << val << std::endl;
+    }
+}
+
+template<typename TIdTrie>
+void check_id_trie(const std::string& name, const TIdTrie& trie, const oracle_type& oracle,
+                   const std::vector<std::string>& queries)
+{
+    check_fsm(name, trie, oracle, queries);
+    for (const std::string& str : queries) {
+        const oracle_type::const_iterator it = oracle.find(str);
+        const size_t id = (it != oracle.cend()) ? (size_t)std::distance(oracle.cbegin(), it) : TIdTrie::invalid_id;
+        EXPECTED(trie.id(str) == id) << name << ": '" << str << "' " << trie.id(str) << " != " << id << std::endl;
+    }
+    size_t id = 0;
+    for (const oracle_type::value_type& kv : oracle) {
+        std::string key;
+        EXPECTED(trie.key(id, key) && (key == kv.first)) << name << ": " << id << " '" << key << "'" << std::endl;
+        ++id;
+    }
+}
+
+template<typename TTrans>
+void check_all(const std::string& name, const oracle_type& oracle, const std::vector<std::string>& queries)
+{
+    fsm::fsm<TTrans> fsm;
+    fsm::trie<size_t, TTrans> trie;
+    fsm::id_trie<TTrans> id_trie;
+    fsm::pool<size_t, TTrans> pool;
+    for (const oracle_type::value_type& kv : oracle) {
+        EXPECTED(fsm.insert(kv.first)) << name << ": '" << kv.first << "'" << std::endl;
+        EXPECTED(trie.insert(kv.first, kv.second)) << name << ": '" << kv.first << "'" << std::endl;
+        EXPECTED(id_trie.insert(kv.first)) << name << ": '" << kv.first << "'" << std::endl;
+        EXPECTED(pool.insert(0, kv.first)) << name << ": '" << kv.first << "'" << std::endl;
+        EXPECTED(pool.insert(1, kv.first + "a")) << name << ": '" << kv.first << "'" << std::endl;
+    }
+    pool.commit();
+    id_trie.index();
+
+    check_fsm(name + ".fsm", fsm, oracle, queries);
+    check_fsm(name + ".compact", fsm::compact_fsm<TTrans>(fsm), oracle, queries);
+    check_trie(name + ".trie", trie, oracle, queries);
+    check_trie(name + ".louds", fsm::louds_trie<size_t, TTrans>(trie), oracle, queries);
+    check_id_trie(name + ".id_trie", id_trie, oracle, queries);
+    for (const std::string& str : queries) {
+        EXPECTED(pool.follow(0, str) == (oracle.count(str) != 0)) << name << ".pool: '" << str << "'" << std::endl;
+        const bool is_tenant_key = ! str.empty() && (str.back() == 'a') && (oracle.count(str.substr(0, str.size() - 1)) != 0);
+        EXPECTED(pool.follow(1, str) == is_tenant_key) << name << ".pool[1]: '" << str << "'" << std::endl;
+    }
+    for (const oracle_type::value_type& kv : oracle) {
+        EXPECTED(pool.follow(1, kv.first + "a")) << name << ".pool[1]: '" << kv.first << "a'" << std::endl;
+    }
+
+    std::vector<size_t> visits;
+    for (const std::string& str : queries) {
+        fsm.count_visits(str, visits);
+    }
+    fsm.relayout(visits, 1);
+    trie.relayout();
+    check_fsm(name + ".fsm.relayout", fsm, oracle, queries);
+    check_fsm(name + ".compact.relayout", fsm::compact_fsm<TTrans>(fsm), oracle, queries);
+    check_trie(name + ".trie.relayout", trie, oracle, queries);
+    check_trie(name + ".louds.relayout", fsm::louds_trie<size_t, TTrans>(trie), oracle, queries);
+}
+
+void run_case(const std::vector<std::string>& keys, const std::vector<std::string>& extra_queries)
+{
+    oracle_type oracle;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        oracle[keys[i]] = i;
+    }
+
+    std::vector<std::string> queries(extra_queries);
+    for (const std::string& key : keys) {
+        for (size_t i = 0; i <= key.size(); ++i) {
+            queries.emplace_back(key.substr(0, i));
+        }
+        queries.emplace_back(key + "a");
+    }
+
+    check_all<str_trans_flat>("flat", oracle, queries);
+    check_all<str_trans_flex>("flex", oracle, queries);
+}
+
+std::string random_key(std::mt19937_64& gen)
+{
+    std::string res(gen() % (k_max_key_size + 1), 'a');
+    for (char& ch : res) {
+        ch = (char)('a' + gen() % k_alphabet_size);
+    }
+    return res;
+}
+
+/*
+ * Random pattern over 'a', 'b', 'c' with groups, alternations, classes and quantifiers. Only one
+ * quantifier follows an atom, because std::regex rejects 'a**'.
+ */
+std::string random_pattern(std::mt19937_64& gen, const size_t depth)
+{
+    static const std::vector<std::string> quantifiers = {"", "", "?", "?", "*", "+", "{2}", "{0,2}", "{1,}", "{2,}", "{1,3}"};
+
+    std::string res;
+    const size_t alts = (gen() % 4 == 0) ? 2 : 1;
+    for (size_t alt = 0; alt < alts; ++alt) {
+        if (alt > 0) {
+            res += '|';
+        }
+        const size_t atoms = 1 + gen() % 3;
+        for (size_t i = 0; i < atoms; ++i) {
+            switch ((depth > 0) ? gen() % 5 : gen() % 3) {
+            case 0:  res += "[ab]"; break;
+            case 1:  res += "."; break;
+            case 2:  res += (char)('a' + gen() % 3); break;
+            default: res += "(" + random_pattern(gen, depth - 1) + ")"; break;
+            }
+            res += quantifiers[gen() % quantifiers.size()];
+        }
+    }
+    return res;
+}
+
+std::string random_input(std::mt19937_64& gen)
+{
+    std::string res(gen() % 9, 'a');
+    for (char& ch : res) {
+        ch = (char)('a' + gen() % 3);
+    }
+    return res;
+}
+
+} // <anonymous> namespace
+
+TEST(differential, random)
+{
+    const size_t seed = env_or("FSM_DIFF_SEED", 20221);
+    const size_t iterations = env_or("FSM_DIFF_ITERATIONS", 100);
+
+    std::mt19937_64 gen(seed);
+    for (size_t i = 0; (i < iterations) && (::tests::details::tester::ut_result() == 0); ++i) {
+        std::vector<std::string> keys(gen() % 64);
+        for (std::string& key : keys) {
+            key = random_key(gen);
+        }
+        std::vector<std::string> queries(64);
+        for (std::string& str : queries) {
+            str = random_key(gen);
+        }
+        run_case(keys, queries);
+    }
+}
+
+TEST(differential, regex)
+{
+    const size_t seed = env_or("FSM_DIFF_SEED", 20221);
+    const size_t iterations = env_or("FSM_DIFF_ITERATIONS", 100);
+
+    std::mt19937_64 gen(seed);
+    for (size_t i = 0; (i < iterations) && (::tests::details::tester::ut_result() == 0); ++i) {
+        // Anchors of the regex_set apply to the whole pattern, in ECMAScript only to the first
+        // (last) alternative.
+        std::string pattern = "(" + random_pattern(gen, 1) + ((gen() % 2 == 0) ? ")?" : ")");
+        if (gen() % 2 == 0) {
+            pattern = "^" + pattern;
+        }
+        if (gen() % 2 == 0) {
+            pattern += "$";
+        }
+
+        fsm::regex_set<str_trans_flat> regex;
+        EXPECTED(regex.add(pattern, 0)) << pattern << std::endl;
+        const fsm::regex_set<str_trans_flat>::trie_type dfa = regex.compile();
+        fsm::lazy_dfa<str_trans_flat> lazy(regex);
+        fsm::lazy_dfa<str_trans_flat> bounded(regex, 4, 1);
+        const std::regex etalon(pattern);
+
+        for (size_t j = 0; j < 64; ++j) {
+            const std::string str = random_input(gen);
+            const bool res = std::regex_search(str, etalon);
+            EXPECTED(dfa.follow(str) == res) << "'" << pattern << "': '" << str << "' " << res << std::endl;
+            fsm::lazy_dfa<str_trans_flat>::id_list ids;
+            EXPECTED(lazy.follow(str, ids) == res) << "lazy '" << pattern << "': '" << str << "' " << res << std::endl;
+            EXPECTED(bounded.follow(str, ids) == res) << "bounded '" << pattern << "': '" << str << "' " << res << std::endl;
+        }
+    }
+}
+
+#if defined(FSM_LIBFUZZER)
+/*
+ * The input is the list of keys separated by zero bytes, every other byte is mapped to the alphabet.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* p_data, size_t size)
+{
+    std::vector<std::string> keys(1);
+    for (size_t i = 0; i < size; ++i) {
+        if (p_data[i] == 0) {
+            keys.emplace_back();
+        } else if (keys.back().size() < k_max_key_size) {
+            keys.back().push_back((char)('a' + p_data[i] % k_alphabet_size));
+        }
+    }
+    run_case(keys, std::vector<std::string>());
+    if (::tests::details::tester::ut_result() != 0) {
+        std::abort();
+    }
+    return 0;
+}
+#else
+int main()
+{
+    return RUN_TESTS();
+}
+#endif
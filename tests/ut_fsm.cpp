@@ -1,11 +1,35 @@
+#include <unistd.h>
+
+#include <algorithm>
 #include <array>
+#include <cstdio>
+#include <cstdlib>
 #include <deque>
+#include <filesystem>
+#include <fstream>
 #include <limits>
+#include <list>
 #include <map>
 #include <set>
+#include <thread>
 
+#include "fsm/allocator.h"
+#include "fsm/compact_fsm.h"
 #include "fsm/fsm.h"
+#include "fsm/id_trie.h"
+#include "fsm/interleave.h"
+#include "fsm/lazy_dfa.h"
+#include "fsm/louds.h"
+#include "fsm/mapped_file.h"
+#include "fsm/overlay.h"
+#include "fsm/pool.h"
+#include "fsm/regex.h"
+#include "fsm/reverse.h"
+#include "fsm/scan.h"
+#include "fsm/set_ops.h"
+#include "fsm/stats.h"
 #include "fsm/trie.h"
+#include "fsm/utf8.h"
 
 #include "testdefs.h"
 
@@ -109,6 +133,1112 @@ TYPED_TEST(fsm, fsm_swap)
     }
 }
 
+TYPED_TEST(fsm, for_each_trans_order)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans>;
+
+    // Events are visited in the unsigned order for both flat and flex tables.
+    str_fsm fsm;
+    std::string etalon;
+    for (const char ch : {'\xff', 'b', '\x80', '\0', 'a', '\x7e', '\xc3'}) {
+        if (fsm.insert(std::string(1, ch))) {
+            etalon += ch;
+        }
+    }
+    std::sort(etalon.begin(), etalon.end(), [](const char lhs, const char rhs) {
+                                                return (unsigned char)lhs < (unsigned char)rhs;
+                                            });
+    EXPECTED(etalon.size() == (str_trans::is_flat ? 4 : 7)) << etalon.size() << std::endl;
+
+    std::string events;
+    fsm.for_each_trans(fsm.begin(), [&events](const char ev, const uint32_t&) { events += ev; });
+    EXPECTED(events == etalon) << events.size() << std::endl;
+
+    const fsm::compact_fsm<str_trans> compact(fsm);
+    events.clear();
+    compact.for_each_trans(compact.begin(), [&events](const char ev, const uint32_t&) { events += ev; });
+    EXPECTED(events == etalon) << events.size() << std::endl;
+}
+
+TYPED_TEST(fsm, compact_fsm)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans>;
+    using str_compact_fsm = fsm::compact_fsm<str_trans>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "apple", "banana", "banan"};
+
+    str_fsm fsm;
+    for (const std::string& str : etalon) {
+        EXPECTED(fsm.insert(str)) << str << std::endl;
+    }
+
+    str_compact_fsm compact(fsm);
+    EXPECTED(compact.size() == fsm.size());
+    EXPECTED(compact.state_width() == 1) << compact.state_width() << std::endl;
+    EXPECTED(compact.alphabet_size() == (size_t)'p' + 1) << compact.alphabet_size() << std::endl;
+
+    EXPECTED(! compact.follow(std::string("a")));
+    EXPECTED(! compact.follow(std::string("abc")));
+    EXPECTED(! compact.follow(std::string("xxx")));
+    EXPECTED(! compact.follow(std::string("abcdz")));
+
+    for (const std::string& str : etalon) {
+        EXPECTED(compact.follow(str)) << str << std::endl;
+    }
+}
+
+TYPED_TEST(fsm, compact_fsm_width)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans>;
+    using str_compact_fsm = fsm::compact_fsm<str_trans>;
+
+    std::vector<std::string> etalon;
+    for (size_t i = 0; i < 26 * 26; ++i) {
+        etalon.emplace_back(std::string{(char)('a' + i % 26), (char)('a' + i / 26)});
+    }
+
+    str_fsm fsm_1;
+    for (const std::string& str : etalon) {
+        EXPECTED(fsm_1.insert(str)) << str << std::endl;
+    }
+    str_compact_fsm compact_1(fsm_1);
+    EXPECTED(compact_1.state_width() == 2) << compact_1.state_width() << std::endl;
+    for (const std::string& str : etalon) {
+        EXPECTED(compact_1.follow(str)) << str << std::endl;
+    }
+    EXPECTED(! compact_1.follow(std::string("a")));
+
+    const std::string long_key(std::numeric_limits<uint16_t>::max(), 'a');
+    str_fsm fsm_2;
+    EXPECTED(fsm_2.insert(long_key));
+    str_compact_fsm compact_2(fsm_2);
+    EXPECTED(compact_2.state_width() == 4) << compact_2.state_width() << std::endl;
+    EXPECTED(compact_2.follow(long_key));
+    EXPECTED(! compact_2.follow(long_key.substr(1)));
+}
+
+TYPED_TEST(fsm, pool)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans>;
+    using str_pool = fsm::pool<size_t, str_trans>;
+
+    const std::vector<std::vector<std::string>> etalon = {{"abcd", "abce", "apple", "banana", "banan"},
+                                                          {"abcd", "apple", "banana"},
+                                                          {"xabcd", "xapple", "banana"}};
+
+    str_pool pool;
+    size_t states_count = 0;
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        str_fsm fsm;
+        for (const std::string& str : etalon[i]) {
+            EXPECTED(pool.insert(i, str)) << i << ": " << str << std::endl;
+            EXPECTED(fsm.insert(str)) << str << std::endl;
+        }
+        states_count += fsm.size();
+    }
+    EXPECTED(! pool.follow(0, std::string("abcd")));
+    pool.commit();
+
+    EXPECTED(pool.tenants_count() == etalon.size());
+    EXPECTED(pool.size() < states_count) << pool.size() << " >= " << states_count << std::endl;
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        for (const std::string& str : etalon[i]) {
+            EXPECTED(pool.follow(i, str)) << i << ": " << str << std::endl;
+        }
+    }
+    EXPECTED(! pool.follow(1, std::string("abce")));
+    EXPECTED(! pool.follow(1, std::string("banan")));
+    EXPECTED(! pool.follow(2, std::string("abcd")));
+    EXPECTED(! pool.follow(2, std::string("x")));
+    EXPECTED(! pool.follow(3, std::string("abcd")));
+
+    EXPECTED(pool.insert(1, std::string("banan")));
+    pool.commit();
+    EXPECTED(pool.follow(1, std::string("banan")));
+    for (const std::string& str : etalon[1]) {
+        EXPECTED(pool.follow(1, str)) << str << std::endl;
+    }
+
+    EXPECTED(pool.erase(2));
+    EXPECTED(! pool.follow(2, std::string("banana")));
+    EXPECTED(pool.follow(0, std::string("banana")));
+
+    // States of replaced and erased tenants are freed, the arena is the same as the fresh one.
+    str_pool fresh;
+    for (size_t round = 0; round < 5; ++round) {
+        for (size_t i = 0; i < 2; ++i) {
+            for (const std::string& str : etalon[i]) {
+                EXPECTED(pool.insert(i, str + std::to_string(round))) << i << ": " << str << std::endl;
+                EXPECTED(fresh.insert(i, str + std::to_string(round))) << i << ": " << str << std::endl;
+            }
+        }
+        pool.commit();
+    }
+    EXPECTED(pool.insert(1, std::string("banan")));
+    EXPECTED(fresh.insert(1, std::string("banan")));
+    for (const std::string& str : etalon[0]) {
+        EXPECTED(fresh.insert(0, str)) << str << std::endl;
+    }
+    for (const std::string& str : etalon[1]) {
+        EXPECTED(fresh.insert(1, str)) << str << std::endl;
+    }
+    pool.commit();
+    fresh.commit();
+    EXPECTED(pool.size() == fresh.size()) << pool.size() << " != " << fresh.size() << std::endl;
+    EXPECTED(pool.follow(0, std::string("apple3")));
+    EXPECTED(pool.follow(1, std::string("banan")));
+    EXPECTED(pool.follow(1, std::string("abcd")));
+
+    EXPECTED(pool.erase(0));
+    EXPECTED(pool.erase(1));
+    pool.compact();
+    EXPECTED(pool.size() == str_pool().size()) << pool.size() << std::endl;
+    EXPECTED(pool.tenants_count() == 0);
+}
+
+TYPED_TEST(fsm, pool_deep_chain)
+{
+    using str_trans = TType;
+    using str_pool = fsm::pool<size_t, str_trans>;
+
+    // Commit and re-commit walk the whole chain, so they must not recurse per level.
+    const std::string key(100000, 'a');
+    str_pool pool;
+    EXPECTED(pool.insert(0, key));
+    EXPECTED(pool.insert(1, key));
+    pool.commit();
+    EXPECTED(pool.follow(0, key));
+    EXPECTED(pool.follow(1, key));
+    EXPECTED(pool.size() < key.size() + 10) << pool.size() << std::endl;
+
+    EXPECTED(pool.insert(0, key + "b"));
+    pool.commit();
+    EXPECTED(pool.follow(0, key));
+    EXPECTED(pool.follow(0, key + "b"));
+    EXPECTED(! pool.follow(1, key + "b"));
+    EXPECTED(! pool.follow(0, key.substr(1)));
+}
+
+TYPED_TEST(fsm, counting_stats)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans, std::vector, fsm::counting_stats>;
+    using str_trie = fsm::trie<size_t, str_trans, std::vector, std::map<uint32_t, size_t>, fsm::counting_stats>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "apple", "banana", "banan"};
+
+    fsm::counting_stats::reset();
+
+    str_fsm fsm;
+    str_trie trie;
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        EXPECTED(fsm.insert(etalon[i])) << etalon[i] << std::endl;
+        EXPECTED(trie.insert(etalon[i], i)) << etalon[i] << std::endl;
+    }
+
+    EXPECTED(fsm.follow(std::string("apple")));
+    EXPECTED(! fsm.follow(std::string("abc")));
+    EXPECTED(! fsm.follow(std::string("xxx")));
+
+    std::thread th([&trie]() {
+                       size_t val;
+                       EXPECTED(trie.follow(std::string("banana"), val));
+                       EXPECTED(! trie.follow(std::string("bananas"), val));
+                   });
+    th.join();
+
+    const fsm::counting_stats::counters c = fsm::counting_stats::snapshot();
+    EXPECTED(c.lookups == 5) << c.lookups << std::endl;
+    EXPECTED(c.accepted == 2) << c.accepted << std::endl;
+    EXPECTED(c.rejected == 2) << c.rejected << std::endl;
+    EXPECTED(c.not_available == 1) << c.not_available << std::endl;
+    EXPECTED(c.transitions == 5 + 3 + 0 + 6 + 6) << c.transitions << std::endl;
+    EXPECTED(c.depth[0] == 1) << c.depth[0] << std::endl;
+    EXPECTED(c.depth[6] == 2) << c.depth[6] << std::endl;
+
+    fsm::counting_stats::reset();
+    EXPECTED(fsm::counting_stats::snapshot().lookups == 0);
+}
+
+TYPED_TEST(fsm, fsm_relayout)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "apple", "banana", "banan"};
+
+    str_fsm fsm;
+    for (const std::string& str : etalon) {
+        EXPECTED(fsm.insert(str)) << str << std::endl;
+    }
+    const size_t size = fsm.size();
+
+    std::vector<size_t> visits;
+    for (size_t i = 0; i < 10; ++i) {
+        fsm.count_visits(std::string("banana"), visits);
+    }
+    fsm.count_visits(std::string("apple"), visits);
+
+    const std::vector<uint32_t> map = fsm.relayout(visits, 1);
+    EXPECTED(fsm.size() == size) << fsm.size() << " != " << size << std::endl;
+    EXPECTED(map.size() == size) << map.size() << " != " << size << std::endl;
+    EXPECTED(fsm.follow(fsm.begin(), 'b') == 2) << fsm.follow(fsm.begin(), 'b') << std::endl;
+    EXPECTED(fsm.follow(fsm.begin(), 'a') == 3) << fsm.follow(fsm.begin(), 'a') << std::endl;
+    // The subtree of "b" follows the top level and is contiguous.
+    uint32_t st = fsm.follow(fsm.begin(), 'b');
+    for (const char ch : std::string("anana")) {
+        const uint32_t st_to = fsm.follow(st, ch);
+        EXPECTED(st_to == st + (st == 2 ? 2 : 1)) << ch << ": " << st_to << std::endl;
+        st = st_to;
+    }
+
+    EXPECTED(! fsm.follow(std::string("a")));
+    EXPECTED(! fsm.follow(std::string("abc")));
+    EXPECTED(! fsm.follow(std::string("xxx")));
+    for (const std::string& str : etalon) {
+        EXPECTED(fsm.follow(str)) << str << std::endl;
+    }
+}
+
+TYPED_TEST(fsm, trie_relayout)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "apple", "banana", "banan"};
+
+    str_trie trie;
+    EXPECTED(trie.insert(std::string("cherry"), 100));
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        EXPECTED(trie.insert(etalon[i], i)) << etalon[i] << std::endl;
+    }
+    trie.relayout();
+
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        size_t val;
+        EXPECTED(trie.follow(etalon[i], val)) << etalon[i] << std::endl;
+        EXPECTED(val == i) << etalon[i] << ": " << val << " != " << i << std::endl;
+    }
+    size_t val = 0;
+    EXPECTED(trie.follow(std::string("cherry"), val));
+    EXPECTED(val == 100) << val << std::endl;
+    EXPECTED(! trie.follow(std::string("abc")));
+}
+
+TYPED_TEST(fsm, huge_page_allocator)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans, fsm::huge_page_vector>;
+    using str_compact_fsm = fsm::compact_fsm<str_trans, fsm::huge_page_vector>;
+
+    std::vector<std::string> etalon;
+    for (size_t i = 0; i < 26 * 26 * 26; ++i) {
+        etalon.emplace_back(std::string{(char)('a' + i % 26), (char)('a' + i / 26 % 26), (char)('a' + i / 676)});
+    }
+
+    str_fsm fsm;
+    for (const std::string& str : etalon) {
+        EXPECTED(fsm.insert(str)) << str << std::endl;
+    }
+    str_compact_fsm compact(fsm);
+    for (const std::string& str : etalon) {
+        EXPECTED(fsm.follow(str)) << str << std::endl;
+        EXPECTED(compact.follow(str)) << str << std::endl;
+    }
+    EXPECTED(! fsm.follow(std::string("ab")));
+    EXPECTED(! compact.follow(std::string("ab")));
+}
+
+TYPED_TEST(fsm, numa_replicas)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "apple", "banana", "banan"};
+
+    str_fsm fsm;
+    for (const std::string& str : etalon) {
+        EXPECTED(fsm.insert(str)) << str << std::endl;
+    }
+
+    const fsm::numa_replicas<str_fsm> replicas(fsm);
+    EXPECTED(replicas.nodes_count() > 0);
+    for (const std::string& str : etalon) {
+        EXPECTED(replicas.local().follow(str)) << str << std::endl;
+        EXPECTED(replicas.get(replicas.nodes_count()).follow(str)) << str << std::endl;
+    }
+    EXPECTED(! replicas.local().follow(std::string("abc")));
+}
+
+TYPED_TEST(fsm, regex_set)
+{
+    using str_trans = TType;
+    using str_regex_set = fsm::regex_set<str_trans>;
+    using id_list = typename str_regex_set::id_list;
+
+    str_regex_set regex;
+    EXPECTED(regex.add("^abc$", 0));
+    EXPECTED(regex.add("^a[0-9]+z$", 1));
+    EXPECTED(regex.add("foo", 2));
+    EXPECTED(regex.add("^(ab|cd){2,3}$", 3));
+    EXPECTED(regex.add("bar$", 4));
+    EXPECTED(regex.add("^x\\d{2,}[^a-c]\\.$", 5));
+    EXPECTED(! regex.add("a(b", 6));
+    EXPECTED(! regex.add("[a-", 6));
+    EXPECTED(! regex.add("*a", 6));
+    EXPECTED(! regex.add("a{3,1}", 6));
+    EXPECTED(! regex.add("a$b", 6));
+    for (const std::string str : {"^a{2}{3}$", "^a?{2}$", "a**", "a+?", "(ab)*{2}", "a{1,}+"}) {
+        EXPECTED(! regex.add(str, 6)) << str << std::endl;
+    }
+    EXPECTED(regex.size() == 6);
+
+    const typename str_regex_set::trie_type dfa = regex.compile();
+
+    const std::vector<std::pair<std::string, id_list>> etalon = {
+        {"abc", {0}}, {"a123z", {1}}, {"xxfooyy", {2}}, {"abab", {3}}, {"abcd", {3}}, {"abcdab", {3}}, {"foobar", {2, 4}},
+        {"abcfoo", {2}}, {"x12d.", {5}}, {"x123d.", {5}}};
+    for (const std::pair<std::string, id_list>& et : etalon) {
+        id_list ids;
+        EXPECTED(dfa.follow(et.first, ids)) << et.first << std::endl;
+        EXPECTED(ids == et.second) << et.first << ": " << ids.size() << std::endl;
+    }
+
+    const std::vector<std::string> rejected = {"", "ab", "abcx", "az", "a12", "fo", "abababab", "barx", "x1d.",
+                                               "x12a.", "x12dd"};
+    for (const std::string& str : rejected) {
+        EXPECTED(! dfa.follow(str)) << str << std::endl;
+    }
+
+    str_regex_set bounded;
+    EXPECTED(bounded.add("^q{0,2}r$", 0));
+    EXPECTED(bounded.add("^s?t{2}u{0}$", 1));
+    EXPECTED(bounded.add("^v{0,}w{1,}$", 2));
+    const typename str_regex_set::trie_type bounded_dfa = bounded.compile();
+    for (const std::string str : {"r", "qr", "qqr", "tt", "stt", "w", "vvww"}) {
+        EXPECTED(bounded_dfa.follow(str)) << str << std::endl;
+    }
+    for (const std::string str : {"qqqr", "t", "sstt", "ttu", "v"}) {
+        EXPECTED(! bounded_dfa.follow(str)) << str << std::endl;
+    }
+
+    // Skips over the optional group must not enter the loop of '{m,}'.
+    str_regex_set optional;
+    EXPECTED(optional.add("^(a{2,})?$", 0));
+    EXPECTED(optional.add("^(xb{2,})?y$", 1));
+    EXPECTED(optional.add("^z(ca{1,})?$", 2));
+    const typename str_regex_set::trie_type optional_dfa = optional.compile();
+    for (const std::string str : {"", "aa", "aaa", "y", "xbby", "xbbby", "z", "zca", "zcaa"}) {
+        EXPECTED(optional_dfa.follow(str)) << str << std::endl;
+    }
+    for (const std::string str : {"a", "by", "bby", "xby", "za", "zc"}) {
+        EXPECTED(! optional_dfa.follow(str)) << str << std::endl;
+    }
+
+    str_regex_set star;
+    EXPECTED(star.add("^a*$", 0));
+    EXPECTED(star.compile().size() == 2) << star.compile().size() << std::endl;
+}
+
+TYPED_TEST(fsm, lazy_dfa)
+{
+    using str_trans = TType;
+    using str_regex_set = fsm::regex_set<str_trans>;
+    using str_lazy_dfa = fsm::lazy_dfa<str_trans>;
+    using id_list = typename str_regex_set::id_list;
+
+    str_regex_set regex;
+    EXPECTED(regex.add("^abc$", 0));
+    EXPECTED(regex.add("^a[0-9]+z$", 1));
+    EXPECTED(regex.add("foo", 2));
+    EXPECTED(regex.add("^(ab|cd){2,3}$", 3));
+    EXPECTED(regex.add("bar$", 4));
+    EXPECTED(regex.add("a.{3}b", 5));
+
+    const typename str_regex_set::trie_type dfa = regex.compile();
+    str_lazy_dfa lazy(regex);
+    str_lazy_dfa bounded(regex, 4, 1);
+
+    const std::vector<std::string> inputs = {"", "abc", "a123z", "xxfooyy", "abab", "abcdab", "foobar", "abcfoo",
+                                             "ab", "abcx", "az", "fo", "abababab", "barx", "a123b", "xxa12345bfoo",
+                                             "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaabbbbbbbbbbbbbbbbb"};
+    for (size_t pass = 0; pass < 2; ++pass) {
+        for (const std::string& str : inputs) {
+            id_list et_ids;
+            const bool et_res = dfa.follow(str, et_ids);
+
+            id_list ids;
+            EXPECTED(lazy.follow(str, ids) == et_res) << str << std::endl;
+            EXPECTED(! et_res || (ids == et_ids)) << str << std::endl;
+
+            id_list bounded_ids;
+            EXPECTED(bounded.follow(str, bounded_ids) == et_res) << str << std::endl;
+            EXPECTED(! et_res || (bounded_ids == et_ids)) << str << std::endl;
+            EXPECTED(bounded.size() <= 4) << bounded.size() << std::endl;
+        }
+    }
+
+    EXPECTED(lazy.get_stats().hits > 0);
+    EXPECTED(lazy.get_stats().flushes == 0);
+    EXPECTED(lazy.get_stats().nfa_fallbacks == 0);
+    EXPECTED(bounded.get_stats().flushes > 0);
+    EXPECTED(bounded.get_stats().nfa_fallbacks > 0);
+
+    // '{m,}' inside optional groups, with the cached DFA and with the NFA fallback.
+    str_regex_set optional;
+    EXPECTED(optional.add("^(a{2,})?$", 0));
+    EXPECTED(optional.add("^(xb{2,})?y$", 1));
+    EXPECTED(optional.add("^z(ca{1,})?$", 2));
+    str_lazy_dfa optional_lazy(optional);
+    str_lazy_dfa optional_bounded(optional, 4, 1);
+    const std::vector<std::pair<std::string, id_list>> optional_etalon = {
+        {"", {0}}, {"aa", {0}}, {"aaa", {0}}, {"y", {1}}, {"xbby", {1}}, {"xbbby", {1}}, {"z", {2}}, {"zca", {2}},
+        {"zcaa", {2}}, {"a", {}}, {"by", {}}, {"bby", {}}, {"xby", {}}, {"za", {}}, {"zc", {}}};
+    for (size_t pass = 0; pass < 2; ++pass) {
+        for (const std::pair<std::string, id_list>& et : optional_etalon) {
+            id_list ids;
+            EXPECTED(optional_lazy.follow(et.first, ids) == ! et.second.empty()) << et.first << std::endl;
+            EXPECTED(et.second.empty() || (ids == et.second)) << et.first << std::endl;
+
+            id_list bounded_ids;
+            EXPECTED(optional_bounded.follow(et.first, bounded_ids) == ! et.second.empty()) << et.first << std::endl;
+            EXPECTED(et.second.empty() || (bounded_ids == et.second)) << et.first << std::endl;
+        }
+    }
+    EXPECTED(optional_bounded.get_stats().nfa_fallbacks > 0);
+}
+
+TYPED_TEST(fsm, set_ops)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans>;
+
+    const std::vector<std::vector<std::string>> etalon = {{"abcd", "apple", "banana"},
+                                                          {"apple", "cherry", "banan"},
+                                                          {"banana", "x"}};
+    std::vector<str_fsm> fsms(etalon.size());
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        for (const std::string& str : etalon[i]) {
+            EXPECTED(fsms[i].insert(str)) << str << std::endl;
+        }
+    }
+
+    const auto all = fsm::union_of(std::vector<const str_fsm*>{&fsms[0], &fsms[1], &fsms[2]});
+    const std::vector<std::pair<std::string, fsm::operand_mask>> masks = {
+        {"abcd", 1}, {"apple", 3}, {"banana", 5}, {"cherry", 2}, {"banan", 2}, {"x", 4}};
+    for (const std::pair<std::string, fsm::operand_mask>& m : masks) {
+        fsm::operand_mask mask = 0;
+        EXPECTED(all.follow(m.first, mask)) << m.first << std::endl;
+        EXPECTED(mask == m.second) << m.first << ": " << mask << " != " << m.second << std::endl;
+    }
+    EXPECTED(! all.follow(std::string("ban")));
+    EXPECTED(! all.follow(std::string("y")));
+
+    const auto both = fsm::intersect(fsms[0], fsms[1]);
+    EXPECTED(both.follow(std::string("apple")));
+    for (const std::string str : {"abcd", "banana", "cherry", "banan"}) {
+        EXPECTED(! both.follow(str)) << str << std::endl;
+    }
+
+    const auto diff = fsm::difference(fsms[0], fsms[1]);
+    EXPECTED(diff.follow(std::string("abcd")));
+    EXPECTED(diff.follow(std::string("banana")));
+    for (const std::string str : {"apple", "cherry", "banan"}) {
+        EXPECTED(! diff.follow(str)) << str << std::endl;
+    }
+    EXPECTED(diff.size() <= fsms[0].size()) << diff.size() << std::endl;
+}
+
+TYPED_TEST(fsm, overlay)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+    using str_overlay = fsm::overlay<size_t, str_trans>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "apple", "banana", "banan"};
+
+    str_trie base;
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        EXPECTED(base.insert(etalon[i], i)) << etalon[i] << std::endl;
+    }
+
+    str_overlay overlay(base);
+    EXPECTED(overlay.insert(std::string("cherry"), 10));
+    EXPECTED(overlay.insert(std::string("apple"), 11));
+    EXPECTED(overlay.delta_size() == 2);
+
+    const std::vector<std::pair<std::string, size_t>> values = {
+        {"abcd", 0}, {"abce", 1}, {"apple", 11}, {"banana", 3}, {"banan", 4}, {"cherry", 10}};
+    const auto check = [&overlay, &values]() {
+            for (const std::pair<std::string, size_t>& v : values) {
+                size_t val = 0;
+                EXPECTED(overlay.follow(v.first, val)) << v.first << std::endl;
+                EXPECTED(val == v.second) << v.first << ": " << val << " != " << v.second << std::endl;
+            }
+            EXPECTED(! overlay.follow(std::string("cher")));
+        };
+    check();
+
+    overlay.merge();
+    EXPECTED(overlay.delta_size() == 0);
+    EXPECTED(overlay.base()->follow(std::string("cherry")));
+    check();
+
+    std::thread reader([&check]() {
+                           for (size_t i = 0; i < 100; ++i) {
+                               check();
+                           }
+                       });
+    for (size_t i = 0; i < 100; ++i) {
+        EXPECTED(overlay.insert("key" + std::to_string(i), i));
+        if (i % 10 == 0) {
+            overlay.merge_async(i % 20 == 0).wait();
+        }
+    }
+    reader.join();
+
+    overlay.merge();
+    for (size_t i = 0; i < 100; ++i) {
+        size_t val = 0;
+        EXPECTED(overlay.follow("key" + std::to_string(i), val)) << i << std::endl;
+        EXPECTED(val == i) << i << ": " << val << std::endl;
+    }
+    check();
+}
+
+TYPED_TEST(fsm, parallel_scan)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+    using match = std::tuple<size_t, size_t, size_t>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "apple", "banana", "banan", "an"};
+
+    str_trie trie;
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        EXPECTED(trie.insert(etalon[i], i)) << etalon[i] << std::endl;
+    }
+
+    std::string text;
+    for (size_t i = 0; text.size() < 10000; ++i) {
+        text += etalon[(i * 7) % etalon.size()];
+        text += std::string(i % 5, 'x');
+    }
+
+    std::vector<match> et_matches;
+    fsm::scan(trie, text.data(), text.size(), [&trie, &et_matches](size_t pos, size_t len, uint32_t st) {
+                                                  et_matches.emplace_back(pos, len, trie.value(st));
+                                              });
+    EXPECTED(! et_matches.empty());
+    for (const match& m : et_matches) {
+        EXPECTED(text.compare(std::get<0>(m), std::get<1>(m), etalon[std::get<2>(m)]) == 0) << std::get<0>(m) << std::endl;
+    }
+
+    for (const size_t chunk_size : {1, 7, 100, 4096}) {
+        for (const size_t chunks_per_thread : {1, 4}) {
+            std::vector<match> matches;
+            bool is_caller_thread = true;
+            fsm::parallel_scan(trie, text.data(), text.size(), 4,
+                               [&trie, &matches, &is_caller_thread, id = std::this_thread::get_id()](
+                                   size_t pos, size_t len, uint32_t st) {
+                                   matches.emplace_back(pos, len, trie.value(st));
+                                   is_caller_thread = is_caller_thread && (std::this_thread::get_id() == id);
+                               },
+                               chunk_size, chunks_per_thread);
+            EXPECTED(matches == et_matches) << chunk_size << "/" << chunks_per_thread << ": " << matches.size()
+                                            << " != " << et_matches.size() << std::endl;
+            EXPECTED(is_caller_thread) << chunk_size << "/" << chunks_per_thread << std::endl;
+        }
+    }
+}
+
+TYPED_TEST(fsm, scan_any_bytes)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+    using match = std::tuple<size_t, size_t, size_t>;
+
+    // Keys with high bytes are rejected by the flat table and accepted by the flex one.
+    const std::vector<std::string> keys = {"ab", "abc", "b", "\xc3\xa9", "a\xff"};
+    std::vector<std::string> etalon;
+    str_trie trie;
+    for (const std::string& key : keys) {
+        if (trie.insert(key, etalon.size())) {
+            etalon.emplace_back(key);
+        }
+    }
+    EXPECTED(etalon.size() == (str_trans::is_flat ? 3 : keys.size())) << etalon.size() << std::endl;
+
+    std::string text = "xx ab \xc3\xa9 ab";
+    for (size_t i = 0; i < 256 * 4; ++i) {
+        text += (char)(i * 37 % 256);
+        text += (i % 3 == 0) ? "ab" : "a";
+    }
+
+    std::vector<match> et_matches;
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        for (size_t len = 1; pos + len <= text.size(); ++len) {
+            const std::vector<std::string>::const_iterator it = std::find(etalon.begin(), etalon.end(), text.substr(pos, len));
+            if (it != etalon.end()) {
+                et_matches.emplace_back(pos, len, it - etalon.begin());
+            }
+            if (len > 3) {
+                break;
+            }
+        }
+    }
+
+    std::vector<match> matches;
+    fsm::scan(trie, text.data(), text.size(), [&trie, &matches](size_t pos, size_t len, uint32_t st) {
+                                                  matches.emplace_back(pos, len, trie.value(st));
+                                              });
+    EXPECTED(matches == et_matches) << matches.size() << " != " << et_matches.size() << std::endl;
+
+    matches.clear();
+    fsm::parallel_scan(trie, text.data(), text.size(), 3,
+                       [&trie, &matches](size_t pos, size_t len, uint32_t st) {
+                           matches.emplace_back(pos, len, trie.value(st));
+                       },
+                       64);
+    EXPECTED(matches == et_matches) << matches.size() << " != " << et_matches.size() << std::endl;
+}
+
+TYPED_TEST(fsm, scan_file)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+    using match = std::tuple<size_t, size_t, size_t>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "apple", "banana", "banan", "an"};
+
+    str_trie trie;
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        EXPECTED(trie.insert(etalon[i], i)) << etalon[i] << std::endl;
+    }
+
+    // Text with UTF-8 and other bytes out of the flat alphabet.
+    std::string text;
+    for (size_t i = 0; text.size() < 100000; ++i) {
+        text += etalon[(i * 7) % etalon.size()];
+        text += std::string(i % 5, 'x');
+        text += (i % 2 == 0) ? "\xd0\xbf\xd1\x80\xd0\xb8" : std::string(1, (char)(0x80 + i % 128));
+    }
+
+    std::string path = (std::filesystem::temp_directory_path() / "ut_fsm_scan_file_XXXXXX").string();
+    const int fd = ::mkstemp(path.data());
+    EXPECTED(fd >= 0) << path << std::endl;
+    ::close(fd);
+    std::ofstream(path, std::ios::binary) << text;
+
+    std::vector<match> et_matches;
+    fsm::scan(trie, text.data(), text.size(), [&trie, &et_matches](size_t pos, size_t len, uint32_t st) {
+                                                  et_matches.emplace_back(pos, len, trie.value(st));
+                                              });
+    EXPECTED(! et_matches.empty());
+
+    for (const size_t readahead : {4096, 65536, 1 << 20}) {
+        std::vector<match> matches;
+        EXPECTED(fsm::scan_file(trie, path,
+                                [&trie, &matches](size_t pos, size_t len, uint32_t st) {
+                                    matches.emplace_back(pos, len, trie.value(st));
+                                },
+                                readahead));
+        EXPECTED(matches == et_matches) << readahead << ": " << matches.size() << " != " << et_matches.size() << std::endl;
+    }
+
+    fsm::mapped_file file(path);
+    EXPECTED(file.is_open());
+    EXPECTED(file.size() == text.size());
+    EXPECTED(std::string(file.data(), file.size()) == text);
+    file.close();
+    EXPECTED(! file.is_open());
+
+    std::remove(path.c_str());
+    EXPECTED(! fsm::scan_file(trie, path, [](size_t, size_t, uint32_t) {}));
+
+    std::ofstream(path, std::ios::binary).flush();
+    size_t count = 0;
+    EXPECTED(fsm::scan_file(trie, path, [&count](size_t, size_t, uint32_t) { ++count; }));
+    EXPECTED(count == 0);
+    std::remove(path.c_str());
+}
+
+TYPED_TEST(fsm, id_trie)
+{
+    using str_trans = TType;
+    using str_id_trie = fsm::id_trie<str_trans>;
+
+    const std::vector<std::string> etalon = {"abcd", "abce", "abc", "apple", "banana", "banan", "b", "", "zz"};
+    const std::set<std::string> sorted(etalon.begin(), etalon.end());
+
+    str_id_trie trie;
+    for (const std::string& str : etalon) {
+        EXPECTED(trie.insert(str)) << str << std::endl;
+    }
+    EXPECTED(trie.insert(std::string("abc")));
+    EXPECTED(trie.keys_count() == sorted.size()) << trie.keys_count() << " != " << sorted.size() << std::endl;
+    trie.index();
+
+    size_t id = 0;
+    for (const std::string& str : sorted) {
+        EXPECTED(trie.id(str) == id) << str << ": " << trie.id(str) << " != " << id << std::endl;
+        std::string key;
+        EXPECTED(trie.key(id, key) && (key == str)) << id << ": '" << key << "' != '" << str << "'" << std::endl;
+        ++id;
+    }
+
+    for (const std::string str : {"ab", "abcde", "c", "bananas", "z"}) {
+        EXPECTED(trie.id(str) == str_id_trie::invalid_id) << str << std::endl;
+    }
+    std::string key = "x";
+    EXPECTED(! trie.key(sorted.size(), key) && key.empty());
+
+    // Ids of keys after the inserted one are shifted, there are no ids until 'index()'.
+    EXPECTED(trie.insert(std::string("ab")));
+    EXPECTED(trie.id(std::string("ab")) == str_id_trie::invalid_id);
+    EXPECTED(trie.id(std::string("abc")) == str_id_trie::invalid_id);
+    EXPECTED(! trie.key(0, key));
+    trie.index();
+    EXPECTED(trie.id(std::string("ab")) == 1);
+    EXPECTED(trie.id(std::string("abc")) == 2);
+    EXPECTED(trie.id(std::string("zz")) == sorted.size());
+    EXPECTED(trie.key(sorted.size(), key) && (key == "zz"));
+
+    str_id_trie other;
+    other.swap(trie);
+    EXPECTED(other.keys_count() == sorted.size() + 1);
+    EXPECTED(trie.keys_count() == 0);
+    other.clear();
+    EXPECTED(other.keys_count() == 0);
+    EXPECTED(other.id(std::string("zz")) == str_id_trie::invalid_id);
+
+    // Keys are ordered by unsigned bytes like std::string, events out of the alphabet are rejected.
+    const std::set<std::string> high = {"\xc3\xa9", "z", "a\xff", "a", "ab"};
+    const size_t other_size = other.size();
+    for (const std::string& str : high) {
+        EXPECTED(other.insert(str) == other.is_valid_event(str.back())) << str << std::endl;
+    }
+    if constexpr (str_trans::is_flat) {
+        // Rejected keys do not leave their prefixes.
+        EXPECTED(! other.insert(std::string("qr\xff")));
+        EXPECTED(other.size() == other_size + 3) << other.size() << std::endl;
+    }
+    other.index();
+    id = 0;
+    for (const std::string& str : high) {
+        if (other.is_valid_event(str.back())) {
+            EXPECTED(other.id(str) == id) << str << ": " << other.id(str) << " != " << id << std::endl;
+            EXPECTED(other.key(id, key) && (key == str)) << id << ": '" << key << "' != '" << str << "'" << std::endl;
+            ++id;
+        }
+    }
+    EXPECTED(other.keys_count() == id);
+}
+
+TYPED_TEST(fsm, try_insert)
+{
+    using str_trans = TType;
+    using str_fsm = fsm::fsm<str_trans>;
+    using str_trie = fsm::trie<size_t, str_trans>;
+
+    str_fsm fsm;
+    fsm.reserve(fsm.size() + 5);
+    const size_t capacity = fsm.capacity();
+    const size_t size = fsm.size();
+
+    EXPECTED(fsm.try_insert(std::string("abc")) == fsm::insert_status::ok);
+    EXPECTED(fsm.try_insert(std::string("abc")) == fsm::insert_status::exists);
+    EXPECTED(fsm.try_insert(std::string("ab")) == fsm::insert_status::ok);
+    EXPECTED(fsm.try_insert(std::string("abd")) == fsm::insert_status::ok);
+    EXPECTED(fsm.size() == size + 4) << fsm.size() << std::endl;
+    EXPECTED(fsm.try_insert(std::string("xyz")) == fsm::insert_status::no_capacity);
+    EXPECTED(fsm.size() == size + 4) << fsm.size() << std::endl;
+    EXPECTED(fsm.try_insert(std::string("x")) == fsm::insert_status::ok);
+    EXPECTED(fsm.try_insert(std::string("xy")) == fsm::insert_status::no_capacity);
+    EXPECTED(fsm.capacity() == capacity) << fsm.capacity() << " != " << capacity << std::endl;
+
+    for (const std::string str : {"abc", "ab", "abd", "x"}) {
+        EXPECTED(fsm.follow(str)) << str << std::endl;
+    }
+    for (const std::string str : {"a", "xy", "xyz"}) {
+        EXPECTED(! fsm.follow(str)) << str << std::endl;
+    }
+
+    const size_t full_size = fsm.size();
+    if constexpr (str_trans::is_flat) {
+        EXPECTED(fsm.try_insert(std::string(1, (char)-1)) == fsm::insert_status::invalid_event);
+        EXPECTED(fsm.insert(fsm.begin(), (char)-1) == fsm.invalid());
+        EXPECTED(! fsm.insert(std::string("ab") + (char)-1));
+        EXPECTED(! fsm.insert(std::string("qrs") + (char)-1));
+    } else {
+        EXPECTED(fsm.insert(fsm.begin(), 'a') == fsm.invalid());
+    }
+    EXPECTED(fsm.size() == full_size) << fsm.size() << " != " << full_size << std::endl;
+
+    str_trie trie;
+    trie.reserve(trie.size() + 3);
+    EXPECTED(trie.try_insert(std::string("abc"), 1) == fsm::insert_status::ok);
+    EXPECTED(trie.try_insert(std::string("abc"), 2) == fsm::insert_status::exists);
+    EXPECTED(trie.try_insert(std::string("abd"), 3) == fsm::insert_status::no_capacity);
+    size_t val = 0;
+    EXPECTED(trie.follow(std::string("abc"), val) && (val == 1)) << val << std::endl;
+    EXPECTED(! trie.follow(std::string("abd"), val));
+    EXPECTED(trie.capacity() >= trie.size());
+
+    if constexpr (str_trans::is_flat) {
+        const size_t trie_size = trie.size();
+        EXPECTED(! trie.is_valid_event((char)-1));
+        EXPECTED(! trie.insert(std::string("x") + (char)-1, 4));
+        EXPECTED(trie.size() == trie_size) << trie.size() << std::endl;
+        EXPECTED(! trie.follow(std::string("x")));
+    }
+}
+
+TYPED_TEST(fsm, louds_trie)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+    using str_louds_trie = fsm::louds_trie<size_t, str_trans>;
+
+    std::map<std::string, size_t> etalon;
+    for (size_t i = 0; i < 2000; ++i) {
+        std::string str = std::to_string(i * 7919 % 100003);
+        str += (char)('a' + i % 26);
+        etalon[str] = i;
+        etalon[str.substr(0, str.size() / 2)] = i + 1000000;
+    }
+
+    str_trie trie;
+    for (const std::pair<const std::string, size_t>& kv : etalon) {
+        EXPECTED(trie.insert(kv.first, kv.second)) << kv.first << std::endl;
+    }
+    trie.relayout();
+
+    str_louds_trie louds(trie);
+    EXPECTED(louds.size() == trie.size() - 1) << louds.size() << " != " << trie.size() - 1 << std::endl;
+    for (const std::pair<const std::string, size_t>& kv : etalon) {
+        size_t val = 0;
+        EXPECTED(louds.follow(kv.first)) << kv.first << std::endl;
+        EXPECTED(louds.follow(kv.first, val) && (val == kv.second)) << kv.first << ": " << val << std::endl;
+        EXPECTED(! louds.follow(kv.first + "~")) << kv.first << std::endl;
+    }
+    for (const std::string str : {"x", "a", "12345678901"}) {
+        EXPECTED(! louds.follow(str)) << str << std::endl;
+    }
+
+    size_t val = 0;
+    typename str_louds_trie::state_id st = louds.begin();
+    const std::string key = etalon.begin()->first;
+    for (size_t i = 0; i + 1 < key.size(); ++i) {
+        st = louds.follow(st, key[i]);
+        EXPECTED(st != louds.invalid()) << key << std::endl;
+    }
+    EXPECTED(louds.follow(st, key.back(), val) && (val == etalon.begin()->second)) << key << std::endl;
+
+    // Labels, tree bits and values only, without per state transition tables.
+    EXPECTED(louds.memory_size() < louds.size() * (sizeof(char) + 1) + etalon.size() * sizeof(size_t))
+        << louds.memory_size() << std::endl;
+
+    str_louds_trie other;
+    other.swap(louds);
+    EXPECTED(other.follow(key));
+    other.clear();
+    EXPECTED(other.size() == 0);
+
+    // Shared states and cycles are rejected.
+    str_trie shared;
+    EXPECTED(shared.insert(std::string("ab"), 1));
+    typename str_trie::state_id st_a = shared.begin();
+    st_a = shared.follow(st_a, 'a');
+    EXPECTED(shared.link(shared.begin(), 'x', st_a));
+    EXPECTED(! other.assign(shared));
+    EXPECTED(other.size() == 0);
+    EXPECTED(! other.follow(std::string("ab")));
+    EXPECTED(! str_louds_trie(shared).follow(std::string("xb")));
+
+    str_trie cyclic;
+    EXPECTED(cyclic.insert(std::string("ab"), 1));
+    typename str_trie::state_id st_ab = cyclic.begin();
+    st_ab = cyclic.follow(st_ab, 'a');
+    st_ab = cyclic.follow(st_ab, 'b');
+    EXPECTED(cyclic.link(st_ab, 'c', cyclic.begin()));
+    EXPECTED(! other.assign(cyclic));
+    EXPECTED(other.assign(trie));
+    EXPECTED(other.follow(key));
+}
+
+TYPED_TEST(fsm, lookup_scheduler)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+    using state_id = typename str_trie::state_id;
+
+    std::vector<std::string> keys;
+    str_trie trie;
+    for (size_t i = 0; i < 500; ++i) {
+        keys.emplace_back(std::to_string(i * 7919 % 100003));
+        EXPECTED(trie.insert(keys.back(), i)) << keys.back() << std::endl;
+    }
+    keys.emplace_back("");
+    keys.emplace_back("123456789");
+    keys.emplace_back(keys.front().substr(0, 1));
+    keys.emplace_back(keys.back() + "~");
+    keys.emplace_back("a\xf0");
+    keys.emplace_back(keys.front() + "\xff");
+
+    fsm::lookup_scheduler<str_trie> scheduler(trie, 8);
+    std::vector<size_t> values(keys.size(), 0);
+    std::vector<size_t> completed(keys.size(), 0);
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        // Every completed lookup submits the next key from its callback.
+        scheduler.submit(keys[i], [&, i](const state_id& st) {
+                                      ++completed[i];
+                                      values[i] = (st != trie.invalid()) ? trie.value(st) : keys.size();
+                                      scheduler.submit(keys[i + 1], [&, i](const state_id& st) {
+                                                                        ++completed[i + 1];
+                                                                        values[i + 1] = (st != trie.invalid())
+                                                                            ? trie.value(st) : keys.size();
+                                                                    });
+                                  });
+    }
+    EXPECTED(scheduler.pending() == keys.size() / 2) << scheduler.pending() << std::endl;
+    EXPECTED(scheduler.step() > 0);
+    EXPECTED(scheduler.in_flight() <= 8) << scheduler.in_flight() << std::endl;
+    scheduler.run();
+    EXPECTED(scheduler.in_flight() == 0);
+    EXPECTED(scheduler.pending() == 0);
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        // Keys with bytes out of the alphabet are not found.
+        size_t val = 0;
+        const bool is_valid = std::all_of(keys[i].begin(), keys[i].end(),
+                                          [&trie](const char ch) { return trie.is_valid_event(ch); });
+        const bool res = is_valid && trie.follow(keys[i], val);
+        EXPECTED(completed[i] == 1) << keys[i] << ": " << completed[i] << std::endl;
+        EXPECTED(values[i] == (res ? val : keys.size())) << keys[i] << ": " << values[i] << std::endl;
+    }
+}
+
+#if defined(__cpp_impl_coroutine)
+namespace {
+
+struct detached_task final
+{
+    struct promise_type final
+    {
+        detached_task get_return_object() { return detached_task(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+template<typename TTrie>
+detached_task lookup_all(fsm::lookup_scheduler<TTrie>& scheduler, const TTrie& trie,
+                         const std::vector<std::string>& keys, size_t& found)
+{
+    for (const std::string& key : keys) {
+        const typename TTrie::state_id st = co_await scheduler.async_follow(key);
+        if (st != trie.invalid()) {
+            found += trie.value(st);
+        }
+    }
+}
+
+} // <anonymous> namespace
+
+TYPED_TEST(fsm, lookup_scheduler_coroutine)
+{
+    using str_trans = TType;
+    using str_trie = fsm::trie<size_t, str_trans>;
+
+    str_trie trie;
+    std::vector<std::vector<std::string>> requests(32);
+    size_t etalon = 0;
+    for (size_t i = 0; i < 320; ++i) {
+        const std::string key = std::to_string(i * 7919 % 100003);
+        EXPECTED(trie.insert(key, i)) << key << std::endl;
+        requests[i % requests.size()].emplace_back(key);
+        requests[i % requests.size()].emplace_back(key + "~");
+        etalon += i;
+    }
+
+    fsm::lookup_scheduler<str_trie> scheduler(trie, 16);
+    std::vector<size_t> found(requests.size(), 0);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        lookup_all(scheduler, trie, requests[i], found[i]);
+    }
+    scheduler.run();
+
+    size_t res = 0;
+    for (const size_t val : found) {
+        res += val;
+    }
+    EXPECTED(res == etalon) << res << " != " << etalon << std::endl;
+}
+#endif
+
+TYPED_TEST(fsm, reverse_fsm)
+{
+    using str_trans = TType;
+    using str_reverse_fsm = fsm::reverse_fsm<str_trans>;
+
+    str_reverse_fsm fsm;
+    for (const std::string str : {"com", "example.com", "ads.example.com", "tracker.net"}) {
+        EXPECTED(fsm.insert(str)) << str << std::endl;
+    }
+
+    for (const std::string str : {"com", "example.com", "tracker.net"}) {
+        EXPECTED(fsm.follow(str)) << str << std::endl;
+    }
+    for (const std::string str : {"om", "example", "www.example.com", ""}) {
+        EXPECTED(! fsm.follow(str)) << str << std::endl;
+    }
+
+    const std::vector<std::pair<std::string, size_t>> etalon = {
+        {"com", 3}, {"example.com", 11}, {"www.example.com", 11}, {"x.ads.example.com", 15},
+        {"badexample.com", 11}, {"a.tracker.net", 11}, {"tracker.network", str_reverse_fsm::npos},
+        {"co", str_reverse_fsm::npos}, {"", str_reverse_fsm::npos}};
+    for (const std::pair<std::string, size_t>& et : etalon) {
+        const size_t len = fsm.longest_suffix(et.first);
+        EXPECTED(len == et.second) << et.first << ": " << len << " != " << et.second << std::endl;
+        EXPECTED(fsm.any_suffix(et.first) == (et.second != str_reverse_fsm::npos)) << et.first << std::endl;
+    }
+
+    // With the boundary 'badexample.com' matches only 'com'.
+    EXPECTED(fsm.longest_suffix(std::string("badexample.com"), '.') == 3);
+    EXPECTED(fsm.longest_suffix(std::string("www.example.com"), '.') == 11);
+    EXPECTED(fsm.longest_suffix(std::string("xcom"), '.') == str_reverse_fsm::npos);
+    EXPECTED(fsm.any_suffix(std::string("a.tracker.net"), '.'));
+    EXPECTED(! fsm.any_suffix(std::string("atracker.net"), '.'));
+
+    // Bytes out of the alphabet end the walk.
+    EXPECTED(! fsm.any_suffix(std::string("example.co\xff"), '.'));
+    EXPECTED(! fsm.follow(std::string("co\xffm")));
+    EXPECTED(fsm.longest_suffix(std::string("\xc3\xa9.example.com"), '.') == 11);
+    EXPECTED(fsm.longest_suffix(std::string("\xff" "example.com")) == 11);
+
+    // Any bidirectional range is consumed in place.
+    const std::string host = "cdn.ads.example.com";
+    const std::list<char> list(host.begin(), host.end());
+    EXPECTED(fsm.longest_suffix(list.begin(), list.end(), '.') == 15);
+    EXPECTED(fsm.longest_suffix(host.data(), host.data() + 7) == str_reverse_fsm::npos);
+
+    str_reverse_fsm other;
+    other.swap(fsm);
+    EXPECTED(other.any_suffix(host));
+    EXPECTED(! fsm.any_suffix(host));
+    EXPECTED(fsm.insert(std::string()));
+    EXPECTED(fsm.longest_suffix(host) == 0);
+    other.clear();
+    EXPECTED(! other.any_suffix(host));
+}
+
 TYPED_TEST(fsm, base_trie)
 {
     using str_trans = TType;
@@ -259,6 +1389,78 @@ TYPED_TEST(fsm, DISABLED_chech_invalid)
     //EXPECTED(counter == ) << counter << std::endl;
 }
 
+TEST(utf8, base_utf8)
+{
+    using utf8_fsm = fsm::fsm<fsm::utf8::byte_traits<uint32_t>>;
+
+    const std::vector<std::u32string> etalon = {U"abcd", U"\u00e9t\u00e9", U"\u043c\u0438\u0440", U"\U0001F600"};
+
+    utf8_fsm fsm;
+    for (const std::u32string& str : etalon) {
+        EXPECTED(fsm::utf8::insert(fsm, str) != fsm.invalid());
+    }
+    EXPECTED(fsm::utf8::insert(fsm, std::string_view(u8"\u6f22\u5b57")) != fsm.invalid());
+    EXPECTED(fsm::utf8::insert(fsm, std::u32string(1, (char32_t)0xD800)) == fsm.invalid());
+    EXPECTED(fsm::utf8::insert(fsm, std::string_view("\xC0\xAF")) == fsm.invalid());
+
+    EXPECTED(fsm::utf8::follow(fsm, u8"abcd"));
+    EXPECTED(fsm::utf8::follow(fsm, u8"\u00e9t\u00e9"));
+    EXPECTED(fsm::utf8::follow(fsm, u8"\u043c\u0438\u0440"));
+    EXPECTED(fsm::utf8::follow(fsm, u8"\U0001F600"));
+    EXPECTED(fsm::utf8::follow(fsm, u8"\u6f22\u5b57"));
+
+    EXPECTED(! fsm::utf8::follow(fsm, u8"\u00c9t\u00e9"));
+    EXPECTED(! fsm::utf8::follow(fsm, u8"\u043c\u0438"));
+    EXPECTED(! fsm::utf8::follow(fsm, "\xF0\x9F\x98"));
+    EXPECTED(! fsm::utf8::follow(fsm, "\xC3"));
+}
+
+TEST(utf8, case_fold)
+{
+    using utf8_trie = fsm::trie<size_t, fsm::utf8::byte_traits<uint32_t>>;
+
+    const std::vector<std::u32string> etalon = {U"Apple", U"\u00e9t\u00e9", U"\u041c\u0438\u0440",
+                                                U"\u03c3\u03bf\u03c6\u03cc\u03c2", U"\u0141\u00f3d\u017a",
+                                                U"\u03cd", U"\u038f"};
+
+    utf8_trie trie;
+    for (size_t i = 0; i < etalon.size(); ++i) {
+        const uint32_t st = fsm::utf8::insert(trie, etalon[i], true);
+        EXPECTED(st != trie.invalid());
+        trie.set_value(st, i);
+    }
+
+    const std::vector<std::pair<std::string, size_t>> queries = {
+        {u8"apple", 0}, {u8"APPLE", 0}, {u8"aPpLe", 0}, {u8"\u00c9T\u00c9", 1}, {u8"\u00e9T\u00e9", 1},
+        {u8"\u043c\u0438\u0440", 2}, {u8"\u041c\u0418\u0420", 2}, {u8"\u03a3\u039f\u03a6\u038c\u03a3", 3},
+        {u8"\u03c3\u03bf\u03c6\u03cc\u03c3", 3}, {u8"\u0142\u00d3D\u0179", 4}, {u8"\u03cd", 5},
+        {u8"\u038e", 5}, {u8"\u03ce", 6}, {u8"\u038f", 6}};
+    for (const std::pair<std::string, size_t>& q : queries) {
+        const uint32_t st = fsm::utf8::walk(trie, q.first);
+        EXPECTED(st != trie.invalid()) << q.first << std::endl;
+        EXPECTED((st != trie.invalid()) && trie.is_available(st)) << q.first << std::endl;
+        EXPECTED((st != trie.invalid()) && (trie.value(st) == q.second)) << q.first << std::endl;
+    }
+    EXPECTED(! fsm::utf8::follow(trie, u8"appl"));
+    EXPECTED(! fsm::utf8::follow(trie, u8"\u00e9t\u00e8"));
+
+    // Greek letters with tonos.
+    const std::vector<std::pair<char32_t, char32_t>> pairs = {{0x38C, 0x3CC}, {0x38E, 0x3CD}, {0x38F, 0x3CE}};
+    for (const std::pair<char32_t, char32_t>& p : pairs) {
+        EXPECTED(fsm::utf8::to_lower(p.first) == p.second) << (uint32_t)p.first << std::endl;
+        EXPECTED(fsm::utf8::to_upper(p.second) == p.first) << (uint32_t)p.second << std::endl;
+        EXPECTED(fsm::utf8::to_lower(p.second) == p.second) << (uint32_t)p.second << std::endl;
+        EXPECTED(fsm::utf8::to_upper(p.first) == p.first) << (uint32_t)p.first << std::endl;
+    }
+
+    // The folded key conflicts with the key inserted without folding, flat tables overwrite the
+    // transition, flex ones report the conflict.
+    using utf8_flex_trans = fsm::trans_traits<unsigned char, uint32_t, std::map<unsigned char, uint32_t>, false>;
+    fsm::fsm<utf8_flex_trans> mixed;
+    EXPECTED(fsm::utf8::insert(mixed, std::u32string(U"\u00c9"), false) != mixed.invalid());
+    EXPECTED(fsm::utf8::insert(mixed, std::u32string(U"\u00e9"), true) == mixed.invalid());
+}
+
 int main()
 {
     return RUN_TESTS();